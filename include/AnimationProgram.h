@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "GameClock.h"
+
+using RegionBindings = std::unordered_map<std::string, StagingRegionHandle>;
+
+// Declarative animations loaded from a text file and compiled into flat
+// tables. The animations of each region are applied by one updator in a single
+// pass over that region, so regions that don't overlap can run in the same wave.
+//
+// Each line is `<kind> <region> every <frames>` followed by kind specific
+// fields, where region names are bound by the caller:
+//
+//   tiles    <region> every 6 stride 4 offset 1 map 0xE3:0xEB 0xEB:0xE3
+//   position <region> every 3 stride 4 x 3 y 0 step 1 0 wrap 256 240
+//   palette  <region> every 4 offset 0 ramp 0x07 0x17 0x27 0x37
+//   bank     <region> every 2 file batman/tileframes/{}.bin frames 8 source 0xC00
+//
+// tiles    - Remaps one byte of every entry through a 256 entry lookup table
+// position - Adds a step to the x & y bytes of every entry, wrapping at a maximum
+// palette  - Writes the next value of a looping sequence to a single byte
+// bank     - Copies the next of several file dumps over the whole region
+//
+// Entries default to filling the region, `count` limits them. Animations of a
+// region & kind are applied in file order, with kinds applied in the order above.
+class AnimationProgram : public GameClock::UpdateFunction {
+public:
+    // Returns an updator per animated region, in the order they first appear.
+    // Paths, including those inside the file, are relative to pathPrefix.
+    static UpdateList load(const std::string& path, const RegionBindings& regions);
+
+    void execute(void* mappedData) override;
+
+    void saveState(StateWriter& writer) const override;
+
+    void loadState(StateReader& reader) override;
+
+protected:
+    uint getFrequency() const override {
+        // Animations keep their own periods
+        return 1;
+    }
+
+private:
+    AnimationProgram(StagingRegionHandle span): GameClock::UpdateFunction(span) {}
+
+    // Returns true, and records the frame, if an animation with this period is due
+    static bool due(uint frame, uint period, uint& lastFrame) {
+        if (frame - lastFrame >= period) {
+            lastFrame = frame;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    uint frame_ = 0;
+
+    // All offsets below are relative to the start of the region
+
+    struct TileCycles {
+        std::vector<std::array<uint8_t, 256>> lookup;
+        std::vector<uint32_t> firstByte;
+        std::vector<uint32_t> count;
+        std::vector<uint32_t> stride;
+        std::vector<uint> period;
+        std::vector<uint> lastFrame;
+    } tileCycles_;
+
+    struct PositionTracks {
+        std::vector<uint32_t> firstEntry;
+        std::vector<uint32_t> count;
+        std::vector<uint32_t> stride;
+        std::vector<uint32_t> xOffset;
+        std::vector<uint32_t> yOffset;
+        std::vector<uint> xStep;
+        std::vector<uint> yStep;
+        std::vector<uint> xWrap;
+        std::vector<uint> yWrap;
+        std::vector<uint> period;
+        std::vector<uint> lastFrame;
+    } positionTracks_;
+
+    struct PaletteRamps {
+        std::vector<uint32_t> address;
+        // Ranges into values
+        std::vector<uint32_t> firstValue;
+        std::vector<uint32_t> valueCount;
+        std::vector<uint32_t> nextValue;
+        std::vector<uint8_t> values;
+        std::vector<uint> period;
+        std::vector<uint> lastFrame;
+    } paletteRamps_;
+
+    struct TileBanks {
+        std::vector<uint32_t> address;
+        std::vector<uint32_t> size;
+        // Byte offset into data, frames follow each other & are size bytes
+        std::vector<uint32_t> firstFrame;
+        std::vector<uint32_t> frameCount;
+        std::vector<uint32_t> nextFrame;
+        std::vector<uint8_t> data;
+        std::vector<uint> period;
+        std::vector<uint> lastFrame;
+    } tileBanks_;
+};
@@ -26,6 +26,14 @@ public:
         return buffer_;
     }
 
+    const std::vector<uint8_t>& getBuffer() const {
+        return buffer_;
+    }
+
+    void setBuffer(std::vector<uint8_t>&& buffer) {
+        buffer_ = std::move(buffer);
+    }
+
 private:
     std::vector<uint8_t> buffer_;
 };
\ No newline at end of file
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+
+// Storage image kept in VK_IMAGE_LAYOUT_GENERAL for use between compute passes
+class ComputeImage {
+public:
+    ComputeImage(VkDevice device,
+                 VkPhysicalDevice physicalDevice,
+                 VkQueue queue,
+                 VkCommandPool commandPool,
+                 uint32_t width,
+                 uint32_t height,
+                 VkFormat format,
+                 VkImageUsageFlags usage = VK_IMAGE_USAGE_STORAGE_BIT);
+
+    ~ComputeImage();
+
+    ComputeImage(const ComputeImage&) = delete;
+    ComputeImage& operator=(const ComputeImage&) = delete;
+
+    VkImage getImage() const {
+        return image_;
+    }
+
+    VkImageView getImageView() const {
+        return imageView_;
+    }
+
+    uint32_t getWidth() const {
+        return width_;
+    }
+
+    uint32_t getHeight() const {
+        return height_;
+    }
+
+    static uint32_t findMemoryType(VkPhysicalDevice physicalDevice,
+                                   uint32_t typeFilter,
+                                   VkMemoryPropertyFlags properties);
+
+    // Records & waits on a one-off command buffer
+    static void submitImmediate(VkDevice device,
+                                VkQueue queue,
+                                VkCommandPool commandPool,
+                                const std::function<void(VkCommandBuffer)>& record);
+
+private:
+    VkDevice device_;
+    VkImage image_ = VK_NULL_HANDLE;
+    VkDeviceMemory memory_ = VK_NULL_HANDLE;
+    VkImageView imageView_ = VK_NULL_HANDLE;
+    uint32_t width_;
+    uint32_t height_;
+};
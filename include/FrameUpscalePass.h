@@ -0,0 +1,60 @@
+#pragma once
+
+#include <memory>
+
+#include "FrameUpscaler.h"
+#include "PpuComputeNode.h"
+
+// Layout of the uniform read by upscale.comp
+struct UpscaleParams {
+    uint32_t factor;
+    uint32_t filter;
+    uint32_t padding[2];
+};
+
+// GPU counterpart of FrameUpscaler. Once every scanline batch of a frame has
+// run, the frame is upscaled into a larger image that is presented in its place.
+class FrameUpscalePass : public ScanlinePass {
+public:
+    FrameUpscalePass(VulkanApp<F>& app,
+                     VkImageView frameView,
+                     VkImageView upscaledView,
+                     uint upscaledWidth,
+                     uint upscaledHeight,
+                     const UpscaleConfig& config,
+                     const std::vector<char>& upscaleShaderCode);
+
+    ~FrameUpscalePass();
+
+    void recordBeforeDispatch(VkCommandBuffer, uint32_t, uint) override {}
+
+    void recordAfterFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex) override;
+
+private:
+    class UpscaleMat : public ComputeMaterial<F> {
+    public:
+        UpscaleMat(VkDevice device,
+                   VkPhysicalDevice physicalDevice,
+                   std::vector<std::shared_ptr<Descriptor>> descriptors,
+                   const std::vector<char> & computeShaderCode,
+                   uint width,
+                   uint height):
+        ComputeMaterial<F> (device, physicalDevice, descriptors, computeShaderCode),
+        width_(width),
+        height_(height) {}
+
+        // 16x16 workgroups
+        glm::vec3 getDispatchDimensions() override {
+            return glm::vec3((width_ + 15) / 16, (height_ + 15) / 16, 1);
+        }
+
+        void update(uint32_t, VkExtent2D) override {}
+    private:
+        uint width_;
+        uint height_;
+    };
+
+private:
+    std::unique_ptr<Buffer<UpscaleParams>> paramsUbo_;
+    std::unique_ptr<UpscaleMat> upscaleMaterial_;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+enum UpscaleFilter {
+    // Every pixel becomes a factor x factor block
+    UPSCALE_NEAREST = 0,
+    // Scale2x / Scale3x, with Scale4x as Scale2x applied twice. Edges between
+    // flat areas are smoothed without introducing new colors.
+    UPSCALE_SCALENX = 1
+};
+
+struct UpscaleConfig {
+    // 1 leaves frames as rendered, otherwise 2, 3 or 4
+    uint factor = 1;
+    UpscaleFilter filter = UPSCALE_NEAREST;
+
+    // "2x" to "4x" for nearest, "scale2x" to "scale4x" for ScaleNx
+    static UpscaleConfig parse(const std::string& name);
+};
+
+// Integer upscaling of RGBA8 frames on the CPU, vectorized with SSE2 or NEON
+// where available. Borders repeat the edge pixels, matching upscale.comp.
+class FrameUpscaler {
+public:
+    // out holds width * height * factor^2 pixels
+    static void upscale(const UpscaleConfig& config,
+                        const uint8_t* rgba,
+                        uint width,
+                        uint height,
+                        uint8_t* out);
+};
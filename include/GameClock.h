@@ -1,7 +1,11 @@
 #pragma once
 
+#include <algorithm>
 #include <chrono>
 #include "MemoryUpdateComposer.h"
+#include "PpuProfiler.h"
+#include "SessionSnapshot.h"
+#include "ThreadPool.h"
 
 class GameClock {
     static const uint FRAME_DURATION_MICROS = 16666;
@@ -25,6 +29,16 @@ public:
             }
             return false;
         }
+
+        // Internal state for session snapshots. Overrides should call through
+        // to the base class, state held in staging memory is captured separately.
+        virtual void saveState(StateWriter& writer) const {
+            writer.write(lastFrame_);
+        }
+
+        virtual void loadState(StateReader& reader) {
+            reader.read(lastFrame_);
+        }
     protected:
         virtual uint getFrequency() const = 0;
         StagingRegionHandle handle_;
@@ -33,18 +47,58 @@ public:
     };
 
 public:
-    GameClock(Buffer<uint8_t>& stagingBuffer): stagingBuffer_(stagingBuffer) {
+    // Updators whose staging ranges don't overlap run on threadCount threads
+    GameClock(Buffer<uint8_t>& stagingBuffer,
+              size_t stagingSize,
+              PpuProfiler* profiler = nullptr,
+              uint threadCount = 1)
+    : stagingBuffer_(&stagingBuffer),
+      stagingSize_(stagingSize),
+      profiler_(profiler),
+      threadPool_(threadCount) {
         callback_ = std::make_shared<std::function<void(VulkanApp<F>&,uint32_t)>>(
         [this](VulkanApp<F>&,uint32_t) {
             this->tick();
         });
     }
 
+    // Runs updators directly on host memory, for stepping a session without a device.
+    // Only step() is meaningful on such a clock.
+    GameClock(uint8_t* stagingData,
+              size_t stagingSize,
+              PpuProfiler* profiler = nullptr,
+              uint threadCount = 1)
+    : stagingBuffer_(nullptr),
+      hostStagingData_(stagingData),
+      stagingSize_(stagingSize),
+      profiler_(profiler),
+      threadPool_(threadCount) {}
+
+    // Updators that write overlapping staging bytes run in the order they were added
     void addUpdator(std::unique_ptr<UpdateFunction>&& updator) {
+        // Place the updator one wave after the last one it conflicts with
+        const auto& handle = updator->getHandle();
+        uint wave = 0;
+        for (size_t i = 0; i < updators_.size(); ++i) {
+            const auto& other = updators_[i]->getHandle();
+            bool overlaps = handle.stagingDataOffset < other.stagingDataOffset + other.size
+                && other.stagingDataOffset < handle.stagingDataOffset + handle.size;
+            if (overlaps) {
+                wave = std::max(wave, updatorWaves_[i] + 1);
+            }
+        }
         updators_.emplace_back(std::move(updator));
+        updatorWaves_.push_back(wave);
+        if (wave >= waves_.size()) {
+            waves_.resize(wave + 1);
+            dueUpdators_.resize(wave + 1);
+        }
+        waves_[wave].push_back(updators_.size() - 1);
     }
 
     void tick() {
+        PpuProfiler::Span span(profiler_, "GameClock::tick");
+
         // Update current frame count
         auto now = std::chrono::system_clock::now();
         auto deltaTime = std::chrono::duration_cast<std::chrono::microseconds>(now - last_);
@@ -53,27 +107,99 @@ public:
             last_ = now;
         }
 
-        // Update all systems that should run
+        runDueUpdators();
+    }
+
+    // Advances a single frame regardless of wall time, used to replay from a snapshot
+    void step() {
+        currentFrame_ += 1;
+        runDueUpdators();
+    }
+
+    long getCurrentFrame() const {
+        return currentFrame_;
+    }
+
+    void saveState(StateWriter& writer) const {
+        writer.write(currentFrame_);
+        writer.write<uint64_t>(updators_.size());
+        for (const auto& updator : updators_) {
+            updator->saveState(writer);
+        }
+    }
+
+    // Updators must have been added in the same order as when the state was saved
+    void loadState(StateReader& reader) {
+        uint64_t updatorCount;
+        reader.read(currentFrame_);
+        reader.read(updatorCount);
+        if (updatorCount != updators_.size()) {
+            throw std::runtime_error("snapshot was taken with a different set of updators");
+        }
         for (auto& updator : updators_) {
-            if (updator->shouldRun(currentFrame_)) {
-                const auto& handle = updator->getHandle();
-                stagingBuffer_.mapAndExecute(handle.stagingDataOffset, handle.size, [&updator](void* mappedData) {
-                    updator->execute(mappedData);
-                });
-            }
+            updator->loadState(reader);
         }
+        last_ = std::chrono::system_clock::now();
     }
 
     std::shared_ptr<std::function<void(VulkanApp<F>&,uint32_t)>>& getCallback() {
         return callback_;
     }
 
+private:
+    void runDueUpdators() {
+        // Find the updators that should run, wave by wave
+        bool anyDue = false;
+        for (size_t wave = 0; wave < waves_.size(); ++wave) {
+            dueUpdators_[wave].clear();
+            for (size_t updatorIdx : waves_[wave]) {
+                auto& updator = updators_[updatorIdx];
+                if (updator->shouldRun(currentFrame_)) {
+                    dueUpdators_[wave].push_back(updator.get());
+                    anyDue = true;
+                    if (profiler_ != nullptr) {
+                        profiler_->countUpdator(updator->getHandle().size);
+                    }
+                }
+            }
+        }
+        if (!anyDue) {
+            return;
+        }
+
+        // Map the staging buffer once, updators within a wave don't share any bytes
+        auto runWaves = [this](void* mappedData) {
+            uint8_t* stagingData = static_cast<uint8_t*>(mappedData);
+            for (const auto& due : dueUpdators_) {
+                threadPool_.parallelFor(due.size(), [&due, stagingData](size_t i) {
+                    due[i]->execute(stagingData + due[i]->getHandle().stagingDataOffset);
+                });
+            }
+        };
+        if (stagingBuffer_ != nullptr) {
+            stagingBuffer_->mapAndExecute(0, stagingSize_, runWaves);
+        } else {
+            runWaves(hostStagingData_);
+        }
+    }
+
 private:
    std::chrono::time_point<std::chrono::system_clock> last_; 
    long currentFrame_ = 0;
 
    std::vector<std::unique_ptr<UpdateFunction>> updators_;
-   Buffer<uint8_t>& stagingBuffer_;
+   Buffer<uint8_t>* stagingBuffer_;
+   uint8_t* hostStagingData_ = nullptr;
+   size_t stagingSize_;
+   PpuProfiler* profiler_;
+
+   // Wave each updator was placed in & the updators of each wave
+   std::vector<uint> updatorWaves_;
+   std::vector<std::vector<size_t>> waves_;
+   std::vector<std::vector<UpdateFunction*>> dueUpdators_;
+   ThreadPool threadPool_;
    
    std::shared_ptr<std::function<void(VulkanApp<F>&,uint32_t)>> callback_;
-};
\ No newline at end of file
+};
+
+using UpdateList = std::vector<std::unique_ptr<GameClock::UpdateFunction>>;
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <VulkanApp.h>
+
+#include <memory>
+
+#include "Constants.h"
+
+// For tools & servers: only the device & queues are used, nothing is ever presented
+inline std::unique_ptr<VulkanApp<F>> createHeadlessApp(uint width) {
+    auto app = std::make_unique<VulkanApp<F>>(SCANLINES, width);
+    app->init();
+    return app;
+}
@@ -2,9 +2,13 @@
 
 #include "PpuComputeNode.h"
 #include "Constants.h"
+#include "NesAddressMap.h"
 
 #include <vulkan/vulkan.h>
 
+#include <map>
+#include <memory>
+#include <optional>
 #include <vector>
 
 template <uint T> class VulkanApp;
@@ -22,6 +26,15 @@ struct StagingRegionHandle {
     BufferIndex bufferIndex;
 };
 
+// A single copy out of the staging buffer, as seen from the CPU
+struct ScheduledCopy {
+    BufferIndex bufferIndex;
+    VkBufferCopy region;
+};
+
+// Every copy applied during a frame, keyed by the scanline it is applied before
+using UpdateSchedule = std::map<uint, std::vector<ScheduledCopy>>;
+
 class MemoryUpdateComposer {
 public:
     MemoryUpdateComposer(VkBuffer ppuMemory, 
@@ -36,7 +49,7 @@ public:
     StagingRegionHandle addStagingField(BufferIndex dstBuffer, 
                                         size_t dstOffset, 
                                         size_t size,
-                                        void* initialValue = nullptr) {
+                                        const void* initialValue = nullptr) {
         // Construct the handle
         StagingRegionHandle handle;
         handle.stagingDataOffset = stagingData_.size();
@@ -76,11 +89,115 @@ public:
     std::unique_ptr<Buffer<uint8_t>> produceStagingBuffer(VulkanApp<F>& app);
 
     void populateUpdates(PpuComputeNode& ppuNode) {
-        for (const auto& updates : updates_) {
-            for (const auto& [scanline, update] : updates) {
-                ppuNode.addUpdate(scanline, update);
+        for (size_t bufferIndex = 0; bufferIndex < updates_.size(); ++bufferIndex) {
+            for (const auto& [scanline, update] : updates_[bufferIndex]) {
+                ppuNode.addUpdate(scanline,
+                                  MemoryUpdate{update.dst, getDeviceRegions(static_cast<BufferIndex>(bufferIndex), update)});
+            }
+        }
+        ppuNode.setYOffsetTarget(bufferHandles_[BufferIndex::CONTROL], yOffsetLocation_);
+        if (scanlineWriteSource_) {
+            ppuNode.setScanlineWriteSource(scanlineWriteSource_);
+        }
+        if (frameUpdateSource_ && ppuAddressMap_) {
+            // Translated into nes::PackedPPUMemory each frame, as the composer is gone by then
+            auto source = frameUpdateSource_;
+            auto addressMap = *ppuAddressMap_;
+            VkBuffer ppuBuffer = bufferHandles_[BufferIndex::PPU];
+            auto translated = std::make_shared<std::vector<MemoryUpdate>>();
+            ppuNode.setFrameUpdateSource([source, addressMap, ppuBuffer, translated]() -> const std::vector<MemoryUpdate>& {
+                *translated = source();
+                for (auto& update : *translated) {
+                    if (update.dst != ppuBuffer) {
+                        continue;
+                    }
+                    std::vector<VkBufferCopy> regions;
+                    for (const auto& region : update.regions) {
+                        addressMap.translate(region, regions);
+                    }
+                    update.regions = std::move(regions);
+                }
+                return *translated;
+            });
+        } else if (frameUpdateSource_) {
+            ppuNode.setFrameUpdateSource(frameUpdateSource_);
+        }
+    }
+
+    // Handed to the compute node for writes that differ from frame to frame
+    void setScanlineWriteSource(std::function<const std::vector<ScanlineWrite>&()> scanlineWriteSource) {
+        scanlineWriteSource_ = scanlineWriteSource;
+    }
+
+    bool hasScanlineWriteSource() const {
+        return static_cast<bool>(scanlineWriteSource_);
+    }
+
+    // Handed to the compute node for copies out of staging that differ from frame to frame,
+    // with destinations in nes::PPUMemory like staging fields
+    void setFrameUpdateSource(std::function<const std::vector<MemoryUpdate>&()> frameUpdateSource) {
+        frameUpdateSource_ = frameUpdateSource;
+    }
+
+    bool hasFrameUpdateSource() const {
+        return static_cast<bool>(frameUpdateSource_);
+    }
+
+    VkBuffer getBufferHandle(BufferIndex bufferIndex) const {
+        return bufferHandles_[bufferIndex];
+    }
+
+    // PPU copies are rewritten for nes::PackedPPUMemory from here on;
+    // fields keep being added with offsets into nes::PPUMemory
+    void setPpuAddressMap(const NesAddressMap& addressMap) {
+        ppuAddressMap_ = addressMap;
+    }
+
+    // Every copy in nes::PPUMemory addresses, in the order the compute node applies them.
+    // With an address map, nametable copies are repeated into their mirrors so the
+    // result matches what the packed buffer holds.
+    UpdateSchedule getSchedule() const {
+        UpdateSchedule schedule;
+        for (size_t bufferIndex = 0; bufferIndex < updates_.size(); ++bufferIndex) {
+            for (const auto& [scanline, update] : updates_[bufferIndex]) {
+                auto& copies = schedule[scanline];
+                std::vector<VkBufferCopy> regions;
+                if (ppuAddressMap_ && bufferIndex == BufferIndex::PPU) {
+                    for (const auto& region : update.regions) {
+                        ppuAddressMap_->expandMirrors(region, regions);
+                    }
+                } else {
+                    regions = update.regions;
+                }
+                for (const auto& region : regions) {
+                    copies.push_back(ScheduledCopy{static_cast<BufferIndex>(bufferIndex), region});
+                }
+            }
+        }
+        return schedule;
+    }
+
+    // The copies as the device applies them, into nes::PackedPPUMemory when there's an address map
+    UpdateSchedule getDeviceSchedule() const {
+        UpdateSchedule schedule;
+        for (size_t bufferIndex = 0; bufferIndex < updates_.size(); ++bufferIndex) {
+            for (const auto& [scanline, update] : updates_[bufferIndex]) {
+                auto& copies = schedule[scanline];
+                for (const auto& region : getDeviceRegions(static_cast<BufferIndex>(bufferIndex), update)) {
+                    copies.push_back(ScheduledCopy{static_cast<BufferIndex>(bufferIndex), region});
+                }
             }
         }
+        return schedule;
+    }
+
+    size_t getStagingSize() const {
+        return stagingData_.size();
+    }
+
+    // Initial contents of the staging buffer
+    const std::vector<uint8_t>& getStagingData() const {
+        return stagingData_;
     }
 
 private:
@@ -96,6 +213,17 @@ private:
         updates.at(scanline).regions.push_back(mapping);
 
     }
+
+    std::vector<VkBufferCopy> getDeviceRegions(BufferIndex bufferIndex, const MemoryUpdate& update) const {
+        if (!ppuAddressMap_ || bufferIndex != BufferIndex::PPU) {
+            return update.regions;
+        }
+        std::vector<VkBufferCopy> regions;
+        for (const auto& region : update.regions) {
+            ppuAddressMap_->translate(region, regions);
+        }
+        return regions;
+    }
 private:
     std::array<VkBuffer, 3> bufferHandles_;
     size_t yOffsetLocation_;
@@ -105,4 +233,7 @@ private:
 
     std::array<std::unordered_map<uint, MemoryUpdate>, 3> updates_;
     std::unordered_set<uint> scanlinesWithUpdates_;
+    std::optional<NesAddressMap> ppuAddressMap_;
+    std::function<const std::vector<ScanlineWrite>&()> scanlineWriteSource_;
+    std::function<const std::vector<MemoryUpdate>&()> frameUpdateSource_;
 };
\ No newline at end of file
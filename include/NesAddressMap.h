@@ -0,0 +1,42 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "NesMemory.h"
+
+// Maps copies into nes::PPUMemory, which mirrors the PPU address space, onto
+// nes::PackedPPUMemory. Unused address ranges are dropped and nametable
+// writes land in whichever physical nametable the mirroring mode backs them with.
+class NesAddressMap {
+public:
+    // Four screen layouts need all four nametables & can't be packed
+    explicit NesAddressMap(nes::Mirroring mirroring);
+
+    // Whether every pair of nametables the mode mirrors holds the same bytes in the dump
+    bool matches(const nes::PPUMemory& ppu) const;
+
+    nes::Mirroring getMirroring() const {
+        return mirroring_;
+    }
+
+    nes::PackedPPUMemory pack(const nes::PPUMemory& ppu) const;
+
+    // Appends the copies into PackedPPUMemory that stand for a copy into PPUMemory
+    void translate(const VkBufferCopy& region, std::vector<VkBufferCopy>& packed) const;
+
+    // Appends the region, plus a copy into every nametable that mirrors part of it
+    void expandMirrors(const VkBufferCopy& region, std::vector<VkBufferCopy>& mirrored) const;
+
+private:
+    // Calls visit(nametable, from, to) for the bytes of each logical nametable the region
+    // writes, offsets within the table. Where two pieces land in the same physical
+    // nametable the later address wins, as it would if the bytes were written in order.
+    template<typename Visit>
+    void forEachNametablePiece(const VkBufferCopy& region, Visit visit) const;
+
+    nes::Mirroring mirroring_;
+    std::array<uint8_t, 4> nametableMap_;
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <bitset>
+#include <memory>
+
+#include "ComputeImage.h"
+#include "NesFrameTracker.h"
+#include "PpuComputeNode.h"
+
+// Layout of the uniform holding the cells to rasterize, matching bg_cache.comp
+struct BackgroundCacheCells {
+    static const uint MAX_CELLS = 2 * 4 * 960;
+
+    uint32_t count;
+    uint16_t cells[MAX_CELLS];
+};
+static_assert(sizeof(BackgroundCacheCells) <= 16384);
+
+// Keeps a 512x480 rasterization of all four nametables for each background
+// tileset. Cells are rasterized again just before a scanline batch when the
+// tile index, attribute or pattern they use has changed. Cached pixels hold
+// palette indices rather than colors, so palette writes never invalidate it.
+class NesBackgroundCache : public ScanlinePass {
+public:
+    static const uint CACHE_WIDTH = 512;
+    static const uint CACHE_HEIGHT = 2 * 480;
+
+    NesBackgroundCache(VulkanApp<F>& app,
+                       VkBuffer ppuBuffer,
+                       bool compactMemory,
+                       const NesFrameTracker& frameTracker,
+                       const std::vector<char>& rasterShaderCode);
+
+    ~NesBackgroundCache();
+
+    void recordBeforeDispatch(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint firstScanline) override;
+
+    VkImageView getImageView() const {
+        return cacheImage_->getImageView();
+    }
+
+private:
+    // Builds the list of cells whose inputs differ from what was last rasterized
+    void collectDirtyCells(const nes::PPUMemory& ppu);
+
+private:
+    class RasterMat : public ComputeMaterial<F> {
+    public:
+        RasterMat(VkDevice device,
+                  VkPhysicalDevice physicalDevice,
+                  std::vector<std::shared_ptr<Descriptor>> descriptors,
+                  const std::vector<char> & computeShaderCode):
+        ComputeMaterial<F> (device, physicalDevice, descriptors, computeShaderCode) {}
+
+        glm::vec3 getDispatchDimensions() override {
+            return glm::vec3(cellCount_, 1, 1);
+        }
+
+        void setCellCount(uint cellCount) {
+            cellCount_ = cellCount;
+        }
+
+        void update(uint32_t, VkExtent2D) override {}
+    private:
+        uint cellCount_ = 0;
+    };
+
+private:
+    const NesFrameTracker& frameTracker_;
+    std::unique_ptr<ComputeImage> cacheImage_;
+    std::unique_ptr<Buffer<BackgroundCacheCells>> cellBuffer_;
+    std::unique_ptr<RasterMat> rasterMaterial_;
+
+    // PPU memory as of the last rasterization
+    std::unique_ptr<nes::PPUMemory> rasterized_;
+    BackgroundCacheCells pendingCells_;
+};
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "NesMemory.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Starting state & animation shared by the demos, tools & benchmarks. Only
+// depends on NesMemory.h, so processes without Vulkan can use it too.
+namespace nes {
+    // 8x8 sprites, background from the first tileset & sprites from the second
+    inline constexpr Control DEMO_CONTROL{0, 0, 1, 0, 1, 0, 0, 0, {0,0,0,0,0,0}};
+
+    // Background palette entry the demos cycle, & the colors it steps through every 4 frames
+    inline constexpr size_t DEMO_PALETTE_ENTRY = offsetof(PPUMemory, backgroundPalettes[3]) + offsetof(Palette, data[2]);
+    inline constexpr uint8_t DEMO_PALETTE_RAMP[] = {0x07, 0x17, 0x27, 0x37, 0x27, 0x17};
+
+    inline constexpr uint8_t demoPaletteColor(uint64_t step) {
+        return DEMO_PALETTE_RAMP[step % sizeof(DEMO_PALETTE_RAMP)];
+    }
+} // nes
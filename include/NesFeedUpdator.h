@@ -0,0 +1,82 @@
+#pragma once
+
+#include "GameClock.h"
+#include "NesMemory.h"
+#include "ShmFeed.h"
+
+// Applies frames read from a ShmFeedRing. The whole of PPU memory, OAM &
+// Control are mirrored in staging regions, and deltas are copied straight
+// from the ring into them. Only the first frame copies the regions in full,
+// after that only the ranges deltas changed are copied, before scanline 0.
+// Scanline writes are turned into writes of the full Control struct as it
+// stands at that scanline, and are kept until the next frame arrives.
+//
+// Incremental rendering can't see deltas or scanline writes, so leave it off for feeds.
+class NesFeedUpdator : public GameClock::UpdateFunction {
+public:
+    // Adds the mirrored regions to the composer & hands it the changed ranges & scanline writes
+    static std::unique_ptr<NesFeedUpdator> attach(MemoryUpdateComposer& composer,
+                                                  const std::string& feedName,
+                                                  const nes::PPUMemory& ppu,
+                                                  const nes::OAM& oam,
+                                                  const nes::Control& control);
+
+    void execute(void* mappedData) override;
+
+    const std::vector<ScanlineWrite>& getScanlineWrites() const {
+        return scanlineWrites_;
+    }
+
+    // Copies of the ranges changed since the last frame
+    const std::vector<MemoryUpdate>& getUpdates() const {
+        return updates_;
+    }
+
+    // Feed frame number of the last message applied
+    uint64_t getLastFeedFrame() const {
+        return lastFeedFrame_;
+    }
+
+protected:
+    uint getFrequency() const override {
+        // Drains everything the producer has written each frame
+        return 1;
+    }
+
+private:
+    NesFeedUpdator(StagingRegionHandle span,
+                   std::unique_ptr<ShmFeedRing>&& ring,
+                   std::array<VkBuffer, 3> buffers);
+
+    void markChanged(FeedBuffer buffer, size_t offset, size_t size);
+
+    // Turns the changed ranges into copies, merging ones that touch
+    void buildUpdates();
+
+    // Rebuilds the Control writes on top of the staged Control
+    void buildScanlineWrites(const uint8_t* stagingData);
+
+private:
+    struct RegisterWrite {
+        uint16_t scanline;
+        uint8_t offset;
+        uint8_t size;
+        uint8_t bytes[sizeof(nes::Control)];
+    };
+
+    std::unique_ptr<ShmFeedRing> ring_;
+    // Indexed by FeedBuffer
+    std::array<VkBuffer, 3> buffers_;
+    // Mirrored regions relative to the span, indexed by FeedBuffer
+    std::array<size_t, 3> regionOffsets_;
+    std::array<size_t, 3> regionSizes_;
+
+    std::vector<RegisterWrite> registerWrites_;
+    std::vector<nes::Control> scanlineControls_;
+    std::vector<ScanlineWrite> scanlineWrites_;
+    // Changed ranges relative to each region, indexed by FeedBuffer
+    std::array<std::vector<VkBufferCopy>, 3> changed_;
+    std::vector<MemoryUpdate> updates_;
+    bool keyframeCopied_ = false;
+    uint64_t lastFeedFrame_ = 0;
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <bitset>
+#include <vector>
+
+#include "MemoryUpdateComposer.h"
+#include "NesMemory.h"
+
+// CPU-side copy of everything the shader reads
+struct NesMemoryState {
+    nes::PPUMemory ppu;
+    nes::OAM oam;
+    nes::Control control;
+
+    uint8_t* bytes(BufferIndex bufferIndex) {
+        switch (bufferIndex) {
+            case BufferIndex::PPU: return reinterpret_cast<uint8_t*>(&ppu);
+            case BufferIndex::OAM: return reinterpret_cast<uint8_t*>(&oam);
+            default: return reinterpret_cast<uint8_t*>(&control);
+        }
+    }
+
+    const uint8_t* bytes(BufferIndex bufferIndex) const {
+        return const_cast<NesMemoryState*>(this)->bytes(bufferIndex);
+    }
+
+    void apply(const ScheduledCopy& copy, const uint8_t* stagingData) {
+        memcpy(bytes(copy.bufferIndex) + copy.region.dstOffset,
+               stagingData + copy.region.srcOffset,
+               copy.region.size);
+    }
+};
+
+// Follows the copies applied each frame to work out which scanlines could
+// look different from the previous frame. Memory is split into segments at
+// every scanline that has updates, and each segment is compared against the
+// same segment of the previous frame.
+class NesFrameTracker {
+public:
+    NesFrameTracker(const nes::PPUMemory& ppu,
+                    const nes::OAM& oam,
+                    const nes::Control& control,
+                    UpdateSchedule schedule);
+
+    // Simulates this frame's copies out of the staging data
+    void beginFrame(const uint8_t* stagingData);
+
+    const ScanlineMask& getDirtyScanlines() const {
+        return dirtyScanlines_;
+    }
+
+    // Memory as seen by the given scanline during the current frame
+    const NesMemoryState& getStateAt(uint scanline) const;
+
+private:
+    struct Segment {
+        uint firstScanline;
+        uint endScanline;
+        const std::vector<ScheduledCopy>* copies;
+        NesMemoryState state;
+    };
+
+    // Byte range of a buffer that is written by at least one copy
+    struct WatchedRange {
+        BufferIndex bufferIndex;
+        size_t begin;
+        size_t end;
+    };
+
+    void markSegment(const NesMemoryState& previous, const NesMemoryState& current, uint first, uint end);
+
+    uint spriteHeight(const nes::Control& control) const {
+        return control.spriteHeight == 1 ? 16 : 8;
+    }
+
+    void markSprite(const nes::Sprite& sprite, uint height, uint first, uint end) {
+        // Sprite evaluation is delayed by a scanline
+        uint top = sprite.y + 1u;
+        for (uint y = std::max(top, first); y < std::min(top + height, end); ++y) {
+            dirtyScanlines_.set(y);
+        }
+    }
+
+private:
+    UpdateSchedule schedule_;
+    std::vector<WatchedRange> watchedRanges_;
+    std::vector<Segment> segments_;
+    bool firstFrame_ = true;
+    ScanlineMask dirtyScanlines_;
+};
@@ -45,6 +45,31 @@ namespace nes {
     };
     static_assert(sizeof(PPUMemory) == 0x4000);
 
+    // Which of the physical nametables each of the four logical ones reads
+    enum Mirroring {
+        // 0 1 read A, 2 3 read B
+        HORIZONTAL_MIRRORING = 0,
+        // 0 2 read A, 1 3 read B
+        VERTICAL_MIRRORING = 1,
+        // Every nametable reads A
+        SINGLE_SCREEN_MIRRORING = 2,
+        // Cartridge VRAM backs all four
+        FOUR_SCREEN = 3
+    };
+
+    // GPU side PPUMemory without the unused address ranges, and with only the two
+    // nametables the console backs. Logical nametable n reads nameTables[nametableMap[n]].
+    struct PackedPPUMemory {
+        TileSet tileSets[2];
+        Palette backgroundPalettes[4];
+        Palette spritePalettes[4];
+        uint8_t nametableMap[4];
+        // Keeps the nametables 16 byte aligned
+        uint8_t padding[12];
+        NameTable nameTables[2];
+    };
+    static_assert(sizeof(PackedPPUMemory) == 0x2000 + 32 + 16 + 2 * sizeof(NameTable));
+
     // Each sprite is 4 bytes
     struct Sprite {
         uint8_t y;
@@ -73,8 +98,10 @@ namespace nes {
         uint8_t spriteTileset;
         uint8_t nametableStart;
         uint8_t yOffset;
+        // Scanlines in the dispatched batch, 0 renders through the last scanline
+        uint8_t lineCount;
         // Align to 16 bytes for compatibility
-        uint8_t padding[7]; 
+        uint8_t padding[6]; 
     };
     static_assert(sizeof(Control) == 16);
 
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "NesFrameTracker.h"
+
+// CPU port of the plain nes.comp, producing the same RGBA8 pixels. The bgcache,
+// decoded, compact & subgroup variants aren't ported or checked against it.
+// Used where frames are needed without a device, e.g. offline export.
+class NesSoftwareRenderer {
+public:
+    static const uint WIDTH = 256;
+    static const uint BYTES_PER_PIXEL = 4;
+
+    // Writes WIDTH pixels of scanline y, as seen through the given memory
+    static void renderScanline(const NesMemoryState& state, uint y, uint8_t* rgbaRow);
+
+    // Renders every scanline with the memory the tracker simulated for it.
+    // rgba holds WIDTH * SCANLINES pixels.
+    static void renderFrame(const NesFrameTracker& frameTracker, uint8_t* rgba);
+};
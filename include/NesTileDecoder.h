@@ -0,0 +1,86 @@
+#pragma once
+
+#include <bitset>
+#include <memory>
+
+#include "ComputeImage.h"
+#include "MemoryUpdateComposer.h"
+#include "NesMemory.h"
+#include "PpuComputeNode.h"
+
+// Layout of the uniform holding the tiles to decode, matching tile_decode.comp
+struct DecodeTileList {
+    static const uint MAX_TILES = 2 * 256;
+
+    uint32_t count;
+    // tileset * 256 + tile
+    uint16_t tiles[MAX_TILES];
+};
+
+// Keeps both pattern tables decoded to one palette index per pixel, so the
+// main pass reads a byte per pixel instead of extracting two bitplanes. A
+// tile is decoded again before the first scanline batch that follows a copy
+// covering any of its bytes.
+class NesTileDecoder : public ScanlinePass {
+public:
+    // 16x16 tiles per pattern table, the second table below the first
+    static const uint IMAGE_WIDTH = 16 * 8;
+    static const uint IMAGE_HEIGHT = 2 * 16 * 8;
+
+    NesTileDecoder(VulkanApp<F>& app,
+                   VkBuffer ppuBuffer,
+                   bool compactMemory,
+                   const UpdateSchedule& schedule,
+                   const std::vector<char>& decodeShaderCode);
+
+    ~NesTileDecoder();
+
+    void beginFrame() override;
+
+    void recordBeforeDispatch(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint firstScanline) override;
+
+    VkImageView getImageView() const {
+        return decodedImage_->getImageView();
+    }
+
+private:
+    using TileMask = std::bitset<DecodeTileList::MAX_TILES>;
+
+    // Marks the tiles covered by copies scheduled in (fromScanline, toScanline]
+    void markCoveredTiles(int fromScanline, int toScanline);
+
+private:
+    class DecodeMat : public ComputeMaterial<F> {
+    public:
+        DecodeMat(VkDevice device,
+                  VkPhysicalDevice physicalDevice,
+                  std::vector<std::shared_ptr<Descriptor>> descriptors,
+                  const std::vector<char> & computeShaderCode):
+        ComputeMaterial<F> (device, physicalDevice, descriptors, computeShaderCode) {}
+
+        glm::vec3 getDispatchDimensions() override {
+            return glm::vec3(tileCount_, 1, 1);
+        }
+
+        void setTileCount(uint tileCount) {
+            tileCount_ = tileCount;
+        }
+
+        void update(uint32_t, VkExtent2D) override {}
+    private:
+        uint tileCount_ = 0;
+    };
+
+private:
+    std::unique_ptr<ComputeImage> decodedImage_;
+    std::unique_ptr<Buffer<DecodeTileList>> tileBuffer_;
+    std::unique_ptr<DecodeMat> decodeMaterial_;
+
+    // Pattern table tiles touched by the copies at each scheduled scanline
+    std::map<uint, TileMask> coveredTiles_;
+    // Starts full so the first batch decodes everything
+    TileMask pendingTiles_;
+    // Last scanline whose copies are in pendingTiles_ or already decoded this frame
+    int markedThrough_ = -1;
+    DecodeTileList pendingList_;
+};
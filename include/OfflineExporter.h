@@ -0,0 +1,79 @@
+#pragma once
+
+#include <functional>
+#include <ostream>
+
+#include "FrameUpscaler.h"
+#include "GameClock.h"
+#include "NesMemory.h"
+#include "NesSoftwareRenderer.h"
+#include "ScanlineCapture.h"
+
+struct OfflineExportConfig {
+    uint64_t firstFrame = 0;
+    uint64_t frameCount = 0;
+    // 0 uses every hardware thread
+    uint threadCount = 0;
+    // Frames rendered by a worker in one go, from a single restored state
+    uint chunkFrames = 60;
+    // Applied by the workers, so sinks receive factor^2 times the pixels
+    UpscaleConfig upscale;
+    // nes.comp variant the frames stand in for, named like its SPIR-V file.
+    // NesSoftwareRenderer only ports the plain shader, so any other is refused.
+    std::string shaderVariant = "nes";
+};
+
+// Receives frames in order as WIDTH * SCANLINES RGBA8 pixels, or more when upscaled
+using FrameSink = std::function<void(uint64_t frame, const std::vector<uint8_t>& rgba)>;
+
+// Renders a deterministic NES session without a device. Frames are split into
+// chunks that are rendered concurrently, each worker holding its own copy of
+// the session restored from the state at the start of its chunk, and the
+// results are handed to the sink in frame order. A chunk's first frame is
+// always simulated in full, carrying over the memory the previous frame ended with.
+//
+// Frame n is the memory after the clock has been stepped n times.
+class OfflineExporter {
+public:
+    OfflineExporter(const std::string& ppuDumpPath,
+                    const std::string& oamDumpPath,
+                    nes::Control control,
+                    std::function<UpdateList(MemoryUpdateComposer&)> composeUpdates);
+
+    void run(const OfflineExportConfig& config, const FrameSink& sink);
+
+    // Writes frames back to back, e.g. for ffmpeg -f rawvideo -pix_fmt rgba -s 256x240
+    // (-s 1024x960 with a 4x upscale)
+    static FrameSink rawVideoSink(std::ostream& stream);
+
+    // Appends frames to a capture sized for them, which the caller finishes
+    static FrameSink scanlineCaptureSink(ScanlineCaptureWriter& writer);
+
+private:
+    // Independent copy of the session's CPU state
+    struct SessionClone {
+        std::vector<uint8_t> stagingData;
+        std::unique_ptr<GameClock> clock;
+        UpdateSchedule schedule;
+        std::unique_ptr<NesFrameTracker> frameTracker;
+    };
+
+    // Clock state at the start of a chunk
+    struct ChunkSeed {
+        std::vector<uint8_t> stagingData;
+        std::vector<uint8_t> clockState;
+        // Staging data of the frame before, empty for frame 0
+        std::vector<uint8_t> previousStagingData;
+    };
+
+    std::unique_ptr<SessionClone> cloneSession() const;
+
+    // Restores the clone to the seed, with a tracker holding the memory the previous frame ended with
+    void restoreSeed(SessionClone& clone, const ChunkSeed& seed) const;
+
+private:
+    nes::PPUMemory ppu_;
+    nes::OAM oam_;
+    nes::Control control_;
+    std::function<UpdateList(MemoryUpdateComposer&)> composeUpdates_;
+};
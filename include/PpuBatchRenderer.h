@@ -0,0 +1,85 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "ComputeImage.h"
+#include "NesFrameTracker.h"
+#include "PpuComputeNode.h"
+
+// Renders whole frames for up to maxBatch independent memory states with a
+// single submission. Each slot keeps its own memory buffers, frame image &
+// descriptor set, so nothing is created once the renderer is up.
+class PpuBatchRenderer {
+public:
+    static constexpr uint WIDTH = 256;
+    static constexpr size_t FRAME_SIZE = WIDTH * SCANLINES * 4;
+
+    PpuBatchRenderer(VulkanApp<F>& app,
+                     const std::vector<char>& computeShaderCode,
+                     uint maxBatch,
+                     uint linesPerGroup = 1);
+
+    ~PpuBatchRenderer();
+
+    uint getMaxBatch() const {
+        return static_cast<uint>(slots_.size());
+    }
+
+    // Renders states[i] into frames[i] as FRAME_SIZE bytes of RGBA, blocking until done.
+    // Only the first scanlineCount scanlines are dispatched, like a dirty batch would be.
+    void render(const std::vector<const NesMemoryState*>& states,
+                const std::vector<uint8_t*>& frames,
+                uint scanlineCount = SCANLINES);
+
+    // GPU time spent in the last render's dispatches, 0 if the device can't time them
+    double getLastDispatchMicros() const {
+        return lastDispatchMicros_;
+    }
+
+private:
+    class FrameMat : public ComputeMaterial<F> {
+    public:
+        FrameMat(VkDevice device,
+                 VkPhysicalDevice physicalDevice,
+                 std::vector<std::shared_ptr<Descriptor>> descriptors,
+                 const std::vector<char> & computeShaderCode,
+                 uint linesPerGroup):
+        ComputeMaterial<F> (device, physicalDevice, descriptors, computeShaderCode),
+        linesPerGroup_(linesPerGroup) {}
+
+        glm::vec3 getDispatchDimensions() override {
+            return glm::vec3(1, (scanlineCount_ + linesPerGroup_ - 1) / linesPerGroup_, 1);
+        }
+
+        void setScanlineCount(uint scanlineCount) {
+            scanlineCount_ = scanlineCount;
+        }
+
+        void update(uint32_t, VkExtent2D) override {}
+    private:
+        uint linesPerGroup_;
+        uint scanlineCount_ = SCANLINES;
+    };
+
+    struct Slot {
+        std::unique_ptr<Buffer<nes::PPUMemory>> ppu;
+        std::unique_ptr<Buffer<nes::OAM>> oam;
+        std::unique_ptr<Buffer<nes::Control>> control;
+        std::unique_ptr<ComputeImage> frame;
+        std::unique_ptr<FrameMat> material;
+    };
+
+private:
+    VulkanApp<F>& app_;
+    std::vector<Slot> slots_;
+
+    // Host visible, one NesMemoryState & one frame per slot
+    std::unique_ptr<Buffer<uint8_t>> uploadBuffer_;
+    std::unique_ptr<Buffer<uint8_t>> readbackBuffer_;
+
+    // Brackets the dispatches of a render
+    VkQueryPool timestampPool_ = VK_NULL_HANDLE;
+    float timestampPeriod_ = 0.0f;
+    double lastDispatchMicros_ = 0.0;
+};
@@ -3,16 +3,52 @@
 #include <RenderGraph.h>
 #include <Renderable.h>
 
+#include <bitset>
+#include <functional>
 #include <map>
 
 #include "Constants.h"
+#include "PpuProfiler.h"
+
+using ScanlineMask = std::bitset<SCANLINES>;
 
 struct MemoryUpdate {
     VkBuffer dst;
     std::vector<VkBufferCopy> regions;
 };
 
+// Bytes written into a buffer just before the given scanline is rendered,
+// for the current frame only. Offset & size must be multiples of 4, and
+// data must stay valid until the frame has been submitted.
+struct ScanlineWrite {
+    uint scanline;
+    VkBuffer dst;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    const void* data;
+};
+
+// Extra GPU work recorded into a scanline batch ahead of its dispatch
+class ScanlinePass {
+public:
+    virtual ~ScanlinePass() = default;
+
+    // Called before any of the frame's updates are applied
+    virtual void beginFrame() {}
+
+    // Recorded at the start of the frame's command buffer, ahead of its first updates
+    virtual void recordBeforeUpdates(VkCommandBuffer commandBuffer, uint32_t frameIndex) {}
+
+    // Memory already reflects every update up to & including firstScanline
+    virtual void recordBeforeDispatch(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint firstScanline) = 0;
+
+    // Recorded into the frame's last batch, after its dispatch
+    virtual void recordAfterFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex) {}
+};
+
 class PpuComputeNode : public RenderNode<F> {
+    // Worst case is a batch before the first update and one after every scanline
+    static const uint MAX_SCANLINE_BATCHES = SCANLINES + 1;
 public:
     PpuComputeNode(VkDevice device,
                    VkPhysicalDevice physicalDevice,
@@ -20,12 +56,10 @@ public:
                    std::array<VkCommandBuffer, F> commandBuffers,
                    std::vector<std::shared_ptr<Descriptor>> descriptors,
                    const std::vector<char> & computeShaderCode,
-                   VkBuffer stagingBuffer)
-    : RenderNode<F>(device), 
-      computeMaterial_(device, physicalDevice, descriptors, computeShaderCode), 
-      stagingBuffer_(stagingBuffer),
-      computeQueue_(computeQueue),
-      commandBuffers_(commandBuffers){}
+                   VkBuffer stagingBuffer,
+                   PpuProfiler* profiler = nullptr);
+
+    ~PpuComputeNode();
 
     void submit(RenderEvalContext& ctx) override;
 
@@ -35,25 +69,71 @@ public:
         // Add the update to the list of operations for this scanline
         updates_.at(scanline).push_back(update);
     }
+
+    // Location of the field the shader adds to the dispatched scanline index.
+    // The byte after it is given the batch's scanline count.
+    void setYOffsetTarget(VkBuffer controlBuffer, size_t yOffsetLocation) {
+        // vkCmdUpdateBuffer needs a 4 byte aligned destination
+        assert(yOffsetLocation % 4 == 0);
+        controlBuffer_ = controlBuffer;
+        yOffsetLocation_ = yOffsetLocation;
+    }
+
+    // Queried once per frame for the scanlines that need to be rendered again.
+    // Without one, every scanline is rendered every frame.
+    void setDamageSource(std::function<ScanlineMask()> damageSource) {
+        damageSource_ = damageSource;
+    }
+
+    // For shader variants that render several scanlines per workgroup
+    void setLinesPerGroup(uint linesPerGroup) {
+        assert(linesPerGroup > 0);
+        computeMaterial_.setLinesPerGroup(linesPerGroup);
+    }
+
+    void addScanlinePass(std::shared_ptr<ScanlinePass> pass) {
+        scanlinePasses_.push_back(pass);
+    }
+
+    // Queried once at the start of each frame for the buffer to copy updates out of,
+    // for when staging memory is multi-buffered. Without one, the constructor's buffer is used.
+    void setStagingSource(std::function<VkBuffer()> stagingSource) {
+        stagingSource_ = stagingSource;
+    }
+
+    // Queried once per frame for writes that change from frame to frame, in scanline order.
+    // Scanlines with writes start a new batch like updates do.
+    void setScanlineWriteSource(std::function<const std::vector<ScanlineWrite>&()> scanlineWriteSource) {
+        scanlineWriteSource_ = scanlineWriteSource;
+    }
+
+    // Queried once per frame for copies out of staging that change from frame to frame,
+    // applied before the frame's other updates
+    void setFrameUpdateSource(std::function<const std::vector<MemoryUpdate>&()> frameUpdateSource) {
+        frameUpdateSource_ = frameUpdateSource;
+    }
 protected:
     NodeDevice getDeviceType() override {
         return NodeDevice::GPU;
     }
 private:
-    void submitScanlineBatch(RenderEvalContext& ctx, bool wait, bool signal);
+    // Records the batch's writes & dispatch, plus the passes' end of frame work on the last one
+    void recordScanlineBatch(VkCommandBuffer commandBuffer,
+                             uint32_t frameIndex,
+                             uint firstScanline,
+                             bool lastBatch,
+                             const ScanlineWrite* writes = nullptr,
+                             size_t writeCount = 0);
 
-    void applyUpdates(const std::vector<MemoryUpdate>& updates) {
-        for(const auto& update : updates) {
-            applyUpdate(update);
-        }
-    }
+    void recordUpdates(VkCommandBuffer commandBuffer, const std::vector<MemoryUpdate>& updates);
 
-    void applyUpdate(const MemoryUpdate& update);
+    // Reads back the timestamps written the last time this frame index was submitted
+    void resolveTimestamps(uint32_t frameIndex);
 private:
     class CompMat : public ComputeMaterial<F> {
     public:
         glm::vec3 getDispatchDimensions() override {
-            return glm::vec3(1, scanlineCount_, 1);
+            return glm::vec3(1, (scanlineCount_ + linesPerGroup_ - 1) / linesPerGroup_, 1);
         }
 
         CompMat(VkDevice device,
@@ -66,9 +146,18 @@ private:
             scanlineCount_ = scanlineCount;
         }
 
+        uint getScanlineCount() const {
+            return scanlineCount_;
+        }
+
+        void setLinesPerGroup(uint linesPerGroup) {
+            linesPerGroup_ = linesPerGroup;
+        }
+
         void update(uint32_t, VkExtent2D) override {}
     private:
         uint scanlineCount_ = 240;
+        uint linesPerGroup_ = 1;
     };
 private:
     CompMat computeMaterial_;
@@ -76,4 +165,30 @@ private:
     VkQueue computeQueue_;
     std::array<VkCommandBuffer, F> commandBuffers_;
     std::map<uint, std::vector<MemoryUpdate>> updates_{};
+
+    // Incremental rendering
+    VkBuffer controlBuffer_ = VK_NULL_HANDLE;
+    size_t yOffsetLocation_ = 0;
+    std::function<ScanlineMask()> damageSource_;
+
+    std::vector<std::shared_ptr<ScanlinePass>> scanlinePasses_;
+    std::function<const std::vector<ScanlineWrite>&()> scanlineWriteSource_;
+    std::function<const std::vector<MemoryUpdate>&()> frameUpdateSource_;
+    std::function<VkBuffer()> stagingSource_;
+
+    // Instrumentation
+    struct BatchTiming {
+        uint firstScanline;
+        uint scanlineCount;
+    };
+    struct FrameTimings {
+        uint64_t frame = 0;
+        std::vector<BatchTiming> batches;
+    };
+
+    VkDevice device_;
+    PpuProfiler* profiler_;
+    VkQueryPool timestampPool_ = VK_NULL_HANDLE;
+    float timestampPeriod_ = 0.0f;
+    std::array<FrameTimings, F> frameTimings_{};
 };
\ No newline at end of file
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Constants.h"
+
+template <uint T> class VulkanApp;
+
+// Counters gathered for a single rendered frame
+struct FrameStats {
+    uint64_t frame = 0;
+    double startMicros = 0.0;
+    // GameClock, counted against the frame that was current while they ran
+    uint updatorsRun = 0;
+    size_t updatorBytes = 0;
+    // PpuComputeNode::submit
+    uint memoryUpdates = 0;
+    size_t copyBytes = 0;
+    uint queueSubmits = 0;
+    uint scanlineBatches = 0;
+    // Filled in once the frame's timestamp queries have been read back
+    bool gpuResolved = false;
+    double gpuMicros = 0.0;
+};
+
+struct TraceEvent {
+    const char* name;
+    uint64_t frame;
+    double startMicros;
+    double durationMicros;
+    uint track;
+    // First scanline & scanline count for GPU batches
+    uint firstScanline;
+    uint scanlineCount;
+};
+
+class PpuProfiler {
+public:
+    static const size_t FRAME_HISTORY = 512;
+    static const size_t MAX_TRACE_EVENTS = 1 << 16;
+
+    enum Track {
+        CPU_TRACK = 0,
+        GPU_TRACK = 1
+    };
+
+    // Records a CPU span from construction to destruction
+    class Span {
+    public:
+        Span(PpuProfiler* profiler, const char* name)
+        : profiler_(profiler),
+          name_(name),
+          start_(profiler != nullptr ? profiler->nowMicros() : 0.0) {}
+
+        ~Span() {
+            if (profiler_ != nullptr) {
+                profiler_->recordSpan(name_, start_, profiler_->nowMicros() - start_);
+            }
+        }
+    private:
+        PpuProfiler* profiler_;
+        const char* name_;
+        double start_;
+    };
+
+public:
+    PpuProfiler(bool traceEnabled = false)
+    : traceEnabled_(traceEnabled),
+      epoch_(std::chrono::steady_clock::now()) {
+        if (traceEnabled_) {
+            traceEvents_.resize(MAX_TRACE_EVENTS);
+        }
+        callback_ = std::make_shared<std::function<void(VulkanApp<F>&,uint32_t)>>(
+        [this](VulkanApp<F>&,uint32_t) {
+            this->beginFrame();
+        });
+    }
+
+    void beginFrame() {
+        auto& ending = current();
+        ending.updatorsRun += pendingUpdators_.exchange(0, std::memory_order_relaxed);
+        ending.updatorBytes += pendingUpdatorBytes_.exchange(0, std::memory_order_relaxed);
+
+        currentFrame_ += 1;
+        auto& stats = history_[currentFrame_ % FRAME_HISTORY];
+        stats = FrameStats{};
+        stats.frame = currentFrame_;
+        stats.startMicros = nowMicros();
+    }
+
+    // Safe from any thread, such as a simulation thread's clock. Folded into the
+    // frame's stats when the next frame begins.
+    void countUpdator(size_t bytes) {
+        pendingUpdators_.fetch_add(1, std::memory_order_relaxed);
+        pendingUpdatorBytes_.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    void countMemoryUpdate(size_t bytes) {
+        auto& stats = current();
+        stats.memoryUpdates += 1;
+        stats.copyBytes += bytes;
+    }
+
+    void countSubmit() {
+        current().queueSubmits += 1;
+    }
+
+    void countScanlineBatch() {
+        current().scanlineBatches += 1;
+    }
+
+    // GPU durations arrive a few frames late, once the queries for that frame are available
+    void recordGpuBatch(uint64_t frame,
+                        uint firstScanline,
+                        uint scanlineCount,
+                        double offsetMicros,
+                        double durationMicros);
+
+    void recordSpan(const char* name, double startMicros, double durationMicros) {
+        recordEvent(TraceEvent{name, currentFrame_, startMicros, durationMicros, CPU_TRACK, 0, 0});
+    }
+
+    double nowMicros() const {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch_).count();
+    }
+
+    uint64_t getCurrentFrame() const {
+        return currentFrame_;
+    }
+
+    // Returns null if the frame has not started yet or has fallen out of the history
+    const FrameStats* getFrameStats(uint64_t frame) const {
+        const auto& stats = history_[frame % FRAME_HISTORY];
+        return (frame != 0 && stats.frame == frame) ? &stats : nullptr;
+    }
+
+    // All retained frames, oldest first
+    std::vector<FrameStats> getHistory() const;
+
+    bool isTraceEnabled() const {
+        return traceEnabled_;
+    }
+
+    bool writeChromeTrace(const std::string& path) const;
+
+    std::shared_ptr<std::function<void(VulkanApp<F>&,uint32_t)>>& getCallback() {
+        return callback_;
+    }
+
+private:
+    FrameStats& current() {
+        return history_[currentFrame_ % FRAME_HISTORY];
+    }
+
+    void recordEvent(const TraceEvent& event) {
+        if (!traceEnabled_) {
+            return;
+        }
+        traceEvents_[traceHead_ % MAX_TRACE_EVENTS] = event;
+        traceHead_ += 1;
+    }
+
+private:
+    bool traceEnabled_;
+    std::chrono::time_point<std::chrono::steady_clock> epoch_;
+    uint64_t currentFrame_ = 0;
+
+    std::array<FrameStats, FRAME_HISTORY> history_{};
+    std::atomic<uint> pendingUpdators_ = 0;
+    std::atomic<size_t> pendingUpdatorBytes_ = 0;
+
+    // Ring of the most recent trace events
+    std::vector<TraceEvent> traceEvents_;
+    size_t traceHead_ = 0;
+
+    std::shared_ptr<std::function<void(VulkanApp<F>&,uint32_t)>> callback_;
+};
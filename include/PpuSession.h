@@ -1,18 +1,52 @@
 #pragma once
 
 #include <vector>
+#include "FrameUpscaler.h"
 #include "GameClock.h"
+#include "NesMemory.h"
+#include "PpuProfiler.h"
 
 class UniformBufferObject;
 class Image;
+class NesFrameTracker;
+class NesBackgroundCache;
+class NesTileDecoder;
+class FrameUpscalePass;
+class SessionTimeline;
+class SimulationThread;
 
 struct PpuSessionConfig {
     size_t screenWidth;
     size_t yOffsetLocation;
+    // When set, a Chrome trace of the session is written here once it ends
+    std::string traceOutputPath = "";
+    // Only re-render scanlines whose inputs changed since the previous frame
+    bool incrementalRendering = false;
+    // Sample the background from a cached rasterization of all four nametables
+    bool backgroundCache = false;
+    // Read pattern tables from a copy decoded to a byte per pixel, redecoding
+    // tiles only when a memory update covers them
+    bool decodedTiles = false;
+    // Threads used to run clock updators that write disjoint staging memory
+    uint updatorThreads = 1;
+    // Record a snapshot every this many clock frames so the session can seek, 0 disables
+    uint keyframeInterval = 0;
+    // Step the clock on its own thread, publishing staging memory through a triple buffer.
+    // Throws with keyframes, or with updators that hand data straight to the
+    // compute node such as a feed's scanline writes.
+    bool simulationThread = false;
+    // Render with the nes.comp variant that benchmarked fastest on this device,
+    // tuning on first use & reusing the persisted choice afterwards
+    bool autotuneShader = false;
+    // Keep PPU memory on the GPU without its unused ranges & with only the two
+    // nametables the mirroring mode backs. Four screen cartridges can't be packed.
+    bool compactMemory = false;
+    // The cartridge's nametable mirroring, checked against the dump when packing it
+    nes::Mirroring mirroring = nes::FOUR_SCREEN;
+    // Present frames upscaled on the GPU, the window growing to match
+    UpscaleConfig upscale;
 };
 
-using UpdateList = std::vector<std::unique_ptr<GameClock::UpdateFunction>>;
-
 template<typename PPUMemory, typename OAM, typename Control>
 class PpuSession {
 public:
@@ -27,19 +61,46 @@ public:
               const std::string& shaderPath,
               std::function<UpdateList(MemoryUpdateComposer&)> composeUpdates);
 
+    // Starts from memory already in hand rather than dumps
+    void init(const PPUMemory& ppuMemory,
+              const OAM& oam,
+              Control control,
+              const std::string& shaderPath,
+              std::function<UpdateList(MemoryUpdateComposer&)> composeUpdates);
+
+    const PpuProfiler& getProfiler() const {
+        return *profiler_;
+    }
+
+    // Null unless keyframeInterval is set
+    SessionTimeline* getTimeline() {
+        return timeline_.get();
+    }
+
 private:
     PpuSessionConfig config_;
     std::unique_ptr<VulkanApp<F>> app_;
+    std::unique_ptr<PpuProfiler> profiler_;
 
     std::unique_ptr<Buffer<PPUMemory>> ppuUbo_;
+    // Takes the place of ppuUbo_ with compactMemory
+    std::unique_ptr<Buffer<nes::PackedPPUMemory>> packedPpuUbo_;
     std::unique_ptr<Buffer<OAM>> oamUbo_;
     std::unique_ptr<Buffer<Control>> controlUbo_;
 
     std::unique_ptr<Buffer<UniformBufferObject>> mvpUbo_;
     std::unique_ptr<Image> frameTexture_;
+    // Presented instead of frameTexture_ when upscaling
+    std::unique_ptr<Image> upscaledTexture_;
     std::unique_ptr<VulkanSampler> sampler_;
 
     std::unique_ptr<Buffer<uint8_t>> stagingBuffer_;
 
     std::unique_ptr<GameClock> gameClock_;
+    std::unique_ptr<NesFrameTracker> frameTracker_;
+    std::shared_ptr<NesBackgroundCache> backgroundCache_;
+    std::shared_ptr<NesTileDecoder> tileDecoder_;
+    std::shared_ptr<FrameUpscalePass> upscalePass_;
+    std::shared_ptr<SessionTimeline> timeline_;
+    std::unique_ptr<SimulationThread> simulation_;
 };
\ No newline at end of file
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "ComputeImage.h"
+#include "GameClock.h"
+#include "NesMemory.h"
+#include "OfflineExporter.h"
+
+// Hosts many NES sessions on one device without a window or render graph.
+// Every session shares a single pipeline & descriptor pool, and a tick
+// records all of their staging copies & scanline batches into one command
+// buffer with a single submit. The n-th batches of every session are
+// recorded together so they share barriers.
+//
+// With compactMemory every session keeps nes::PackedPPUMemory on the GPU
+// & the shader must be a _compact variant.
+//
+// Frames reach each session's sink one tick after they were submitted, as
+// WIDTH * SCANLINES RGBA8 pixels. Frame n is the memory after n clock steps.
+class PpuSessionHost {
+public:
+    using SessionId = uint64_t;
+
+    PpuSessionHost(VulkanApp<F>& app,
+                   const std::vector<char>& computeShaderCode,
+                   uint maxSessions,
+                   uint updatorThreads = 1,
+                   bool compactMemory = false);
+
+    ~PpuSessionHost();
+
+    // Sessions without a sink are rendered but never read back. The mirroring
+    // is only used with compactMemory, where it's checked against the dump.
+    SessionId addSession(const nes::PPUMemory& ppu,
+                         const nes::OAM& oam,
+                         const nes::Control& control,
+                         nes::Mirroring mirroring,
+                         std::function<UpdateList(MemoryUpdateComposer&)> composeUpdates,
+                         FrameSink sink = nullptr);
+
+    // Waits for the session's last frame, which is still handed to its sink
+    void removeSession(SessionId id);
+
+    size_t getSessionCount() const {
+        return sessions_.size();
+    }
+
+    // Steps every session & submits the next frame of each
+    void tick();
+
+    // Waits for the last submission & hands its frames to the sinks
+    void flush();
+
+private:
+    struct Batch {
+        uint firstScanline;
+        uint scanlineCount;
+        // Copies out of staging applied before the batch, by BufferIndex
+        std::array<std::vector<VkBufferCopy>, 3> copies;
+    };
+
+    struct HostedSession {
+        SessionId id;
+        // Only one of these is set, depending on compactMemory
+        std::unique_ptr<Buffer<nes::PPUMemory>> ppu;
+        std::unique_ptr<Buffer<nes::PackedPPUMemory>> packedPpu;
+        VkBuffer ppuBuffer = VK_NULL_HANDLE;
+        std::unique_ptr<Buffer<nes::OAM>> oam;
+        std::unique_ptr<Buffer<nes::Control>> control;
+        std::unique_ptr<Buffer<uint8_t>> stagingBuffer;
+        std::unique_ptr<GameClock> clock;
+        std::unique_ptr<ComputeImage> frame;
+        std::unique_ptr<Buffer<uint8_t>> readback;
+        FrameSink sink;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+
+        std::vector<Batch> batches;
+        // Updates past the last scanline, applied once the frame is done
+        std::array<std::vector<VkBufferCopy>, 3> lateCopies;
+
+        // The first tick renders frame 0 without stepping
+        bool started = false;
+        bool submitted = false;
+        uint64_t submittedFrame = 0;
+    };
+
+    void createPipeline(const std::vector<char>& computeShaderCode, uint maxSessions);
+    void record(VkCommandBuffer commandBuffer);
+    void recordCopies(VkCommandBuffer commandBuffer,
+                      HostedSession& session,
+                      const std::array<std::vector<VkBufferCopy>, 3>& copies);
+
+private:
+    VulkanApp<F>& app_;
+    VkDevice device_;
+    uint maxSessions_;
+    bool compactMemory_;
+    ThreadPool threadPool_;
+
+    VkDescriptorSetLayout descriptorSetLayout_ = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout_ = VK_NULL_HANDLE;
+    VkPipeline pipeline_ = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool_ = VK_NULL_HANDLE;
+
+    VkCommandBuffer commandBuffer_ = VK_NULL_HANDLE;
+    VkFence submitFence_ = VK_NULL_HANDLE;
+    bool inFlight_ = false;
+
+    std::vector<std::unique_ptr<HostedSession>> sessions_;
+    SessionId nextSessionId_ = 0;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "NesFrameTracker.h"
+#include "RenderProtocol.h"
+
+// Blocking client for a single connection. Sends a full state first and
+// deltas against the previous request afterwards.
+class RenderClient {
+public:
+    explicit RenderClient(const std::string& socketPath);
+
+    ~RenderClient();
+
+    RenderClient(const RenderClient&) = delete;
+    RenderClient& operator=(const RenderClient&) = delete;
+
+    // Returns PpuBatchRenderer::FRAME_SIZE bytes of RGBA, valid until slotCount more renders
+    const uint8_t* render(const NesMemoryState& state);
+
+private:
+    // Feed frame message holding the ranges of state that differ from the last request,
+    // empty if they don't fit
+    std::vector<uint8_t> buildDelta(const NesMemoryState& state) const;
+
+private:
+    int fd_ = -1;
+    RenderServiceHello hello_;
+    const uint8_t* frames_ = nullptr;
+    size_t framesSize_ = 0;
+    std::unique_ptr<NesMemoryState> lastState_;
+    uint64_t nextRequestId_ = 0;
+};
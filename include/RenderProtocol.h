@@ -0,0 +1,64 @@
+#pragma once
+
+#include <sys/un.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Wire format over a Unix domain socket, host endian as both ends share a machine.
+//
+// On connect the service sends a RenderServiceHello naming a shared memory
+// object of slotCount frames. Each request is a RenderRequestHeader followed
+// by payloadSize bytes:
+// - RENDER_FULL_STATE: a NesMemoryState
+// - RENDER_DELTA: a feed frame message (see ShmFeed.h) of FEED_DELTA records,
+//   applied to the state of the connection's previous request
+// Requests are answered in order with a RenderResponse. The n-th request's
+// frame is RGBA in slot n % slotCount, and stays there until slotCount more
+// requests have been answered. At most slotCount requests are read ahead.
+
+struct RenderServiceHello {
+    static constexpr uint32_t MAGIC = 0x52555050; // "PPUR"
+    static constexpr uint32_t VERSION = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t frameSize;
+    char shmName[64];
+};
+
+enum RenderRequestKind : uint32_t {
+    RENDER_FULL_STATE = 0,
+    RENDER_DELTA = 1
+};
+
+struct RenderRequestHeader {
+    uint32_t magic;
+    RenderRequestKind kind;
+    uint64_t requestId;
+    uint32_t payloadSize;
+    uint32_t reserved;
+};
+
+enum RenderStatus : int32_t {
+    RENDER_OK = 0,
+    // A delta was sent before any full state
+    RENDER_NO_BASE_STATE = 1,
+    RENDER_BAD_REQUEST = 2
+};
+
+struct RenderResponse {
+    uint64_t requestId;
+    RenderStatus status;
+    uint32_t slot;
+};
+
+// Socket helpers shared by both ends. Sends never raise SIGPIPE where the platform allows it.
+sockaddr_un renderSocketAddress(const std::string& path);
+void ignoreSigpipe(int fd);
+
+// Each returns false once the peer has gone
+bool sendAll(int fd, const void* data, size_t size);
+bool receiveAll(int fd, void* data, size_t size);
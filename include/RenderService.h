@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "NesFrameTracker.h"
+#include "PpuBatchRenderer.h"
+#include "RenderProtocol.h"
+#include "ShmFeed.h"
+
+struct RenderServiceConfig {
+    std::string socketPath;
+    // Most requests rendered by a single submission
+    uint maxBatch = 16;
+    // How long to wait for other requests to share a batch once one arrives
+    uint batchWindowMicros = 500;
+    // Frames each connection can hold in its shared memory
+    uint slotsPerConnection = 4;
+};
+
+// Keeps one device & PpuBatchRenderer warm and serves render requests from
+// any number of local connections. Requests that arrive close together are
+// rendered by the same submission, whichever connection they came from.
+class RenderService {
+public:
+    RenderService(VulkanApp<F>& app,
+                  const std::vector<char>& computeShaderCode,
+                  RenderServiceConfig config);
+
+    ~RenderService();
+
+    // Serves until stop is called, which is safe from another thread or a signal handler
+    void run();
+
+    void stop() {
+        stopping_ = true;
+    }
+
+private:
+    struct Connection {
+        int fd;
+        std::string shmName;
+        uint8_t* frames;
+        size_t framesSize;
+        // Bytes received but not yet parsed into requests
+        std::vector<uint8_t> inbox;
+        // State as of the last request, which deltas apply to
+        std::unique_ptr<NesMemoryState> state;
+        uint64_t requestsParsed = 0;
+        uint inFlight = 0;
+        bool closed = false;
+    };
+
+    struct PendingRequest {
+        std::shared_ptr<Connection> connection;
+        uint64_t requestId;
+        RenderStatus status;
+        uint32_t slot;
+        std::unique_ptr<NesMemoryState> state;
+    };
+
+    void acceptConnection();
+    void closeConnection(Connection& connection);
+
+    // Reads whatever has arrived, returns false if the peer has gone
+    bool receive(Connection& connection);
+    // Turns buffered bytes into pending requests, returns false on a malformed stream
+    bool parseRequests(const std::shared_ptr<Connection>& connection);
+    RenderStatus applyRequest(Connection& connection, const RenderRequestHeader& header, const uint8_t* payload);
+
+    void renderPending();
+
+private:
+    RenderServiceConfig config_;
+    PpuBatchRenderer renderer_;
+    int listenFd_ = -1;
+    std::atomic<bool> stopping_ = false;
+    uint64_t connectionsAccepted_ = 0;
+
+    std::vector<std::shared_ptr<Connection>> connections_;
+    std::deque<PendingRequest> pending_;
+    std::chrono::steady_clock::time_point batchDeadline_;
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Recording format for frame sequences that mostly repeat the previous frame.
+//
+// Frames are stored as palette indices. A frame record holds the 64 bit hash
+// & pixels of only the scanlines that changed since the previous frame, the
+// pixels entropy coded with rANS. Keyframes hold every scanline & the whole
+// palette so reading can start from them, and a footer indexes them for seeking.
+//
+//   header    ScanlineCaptureHeader
+//   records   uint8 type, uint32 body size, body
+//   footer    uint64 keyframe count, (uint64 frame, uint64 record offset) per keyframe,
+//             uint64 footer offset, uint32 FOOTER_MAGIC
+struct ScanlineCaptureHeader {
+    static constexpr uint32_t MAGIC = 0x5041434E; // "NCAP"
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint32_t FOOTER_MAGIC = 0x58444E49; // "INDX"
+
+    uint32_t magic = MAGIC;
+    uint32_t version = VERSION;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t keyframeInterval = 0;
+};
+
+// Demos write a capture instead of raw frames when the output path ends in .ncap
+inline bool isScanlineCapturePath(const std::string& path) {
+    static const std::string extension = ".ncap";
+    return path.size() >= extension.size()
+        && path.compare(path.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+// Streams frames out as they arrive. The stream doesn't need to be seekable.
+class ScanlineCaptureWriter {
+public:
+    // keyframeInterval 0 only makes the first frame a keyframe
+    ScanlineCaptureWriter(std::ostream& stream, uint width, uint height, uint keyframeInterval = 60);
+
+    // Finishes the capture if finish wasn't called
+    ~ScanlineCaptureWriter();
+
+    ScanlineCaptureWriter(const ScanlineCaptureWriter&) = delete;
+    ScanlineCaptureWriter& operator=(const ScanlineCaptureWriter&) = delete;
+
+    // rgba holds width * height RGBA8 pixels, using at most 256 distinct colors
+    void writeFrame(const uint8_t* rgba);
+
+    // Writes the end record & keyframe index, no frames can follow
+    void finish();
+
+    uint64_t getFrameCount() const {
+        return frameCount_;
+    }
+
+    uint64_t getBytesWritten() const {
+        return bytesWritten_;
+    }
+
+private:
+    void write(const void* data, size_t size);
+
+private:
+    std::ostream& stream_;
+    ScanlineCaptureHeader header_;
+    bool finished_ = false;
+    uint64_t frameCount_ = 0;
+    uint64_t bytesWritten_ = 0;
+
+    std::vector<uint32_t> palette_;
+    std::unordered_map<uint32_t, uint8_t> paletteIndices_;
+    // Palette indices of the previous frame
+    std::vector<uint8_t> previous_;
+    std::vector<uint8_t> current_;
+    // (frame, record offset) of every keyframe
+    std::vector<std::pair<uint64_t, uint64_t>> keyframes_;
+};
+
+// Reads a capture back frame by frame. Seeking needs a seekable stream.
+class ScanlineCaptureReader {
+public:
+    explicit ScanlineCaptureReader(std::istream& stream);
+
+    uint getWidth() const {
+        return header_.width;
+    }
+
+    uint getHeight() const {
+        return header_.height;
+    }
+
+    // Returns false at the end of the capture, otherwise rgba is resized to the frame
+    bool readFrame(std::vector<uint8_t>& rgba);
+
+    // The next readFrame returns this frame. Decodes forward from the keyframe before it.
+    void seek(uint64_t frame);
+
+    // Frame the next readFrame returns
+    uint64_t getNextFrame() const {
+        return nextFrame_;
+    }
+
+    // Known once the footer has been read, which happens on construction for seekable streams
+    bool hasIndex() const {
+        return indexed_;
+    }
+
+    // Of the frame last read, one per scanline
+    const std::vector<uint64_t>& getScanlineHashes() const {
+        return hashes_;
+    }
+
+    const std::vector<bool>& getChangedScanlines() const {
+        return changed_;
+    }
+
+private:
+    void readIndex();
+
+private:
+    std::istream& stream_;
+    ScanlineCaptureHeader header_;
+    uint64_t nextFrame_ = 0;
+    bool ended_ = false;
+    bool indexed_ = false;
+    std::vector<std::pair<uint64_t, uint64_t>> keyframes_;
+
+    std::vector<uint32_t> palette_;
+    std::vector<uint8_t> indices_;
+    std::vector<uint64_t> hashes_;
+    std::vector<bool> changed_;
+    std::vector<uint8_t> record_;
+};
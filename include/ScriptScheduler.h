@@ -0,0 +1,275 @@
+#pragma once
+
+#include <climits>
+#include <coroutine>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "GameClock.h"
+
+class ScriptScheduler;
+
+// Bump allocator for coroutine frames, with freed frames reused by size.
+// Memory is only returned to the system when the arena is destroyed.
+class ScriptArena {
+public:
+    static constexpr size_t ALIGNMENT = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+    explicit ScriptArena(size_t chunkSize = 4096): chunkSize_(chunkSize) {}
+
+    ScriptArena(const ScriptArena&) = delete;
+    ScriptArena& operator=(const ScriptArena&) = delete;
+
+    void* allocate(size_t size);
+
+    void deallocate(void* ptr, size_t size);
+
+private:
+    static size_t roundUp(size_t size) {
+        return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    }
+
+private:
+    size_t chunkSize_;
+    std::vector<std::unique_ptr<std::byte[]>> chunks_;
+    // Bytes used of the last chunk
+    size_t used_ = 0;
+    // Freed blocks by rounded size, each holding a pointer to the next
+    std::unordered_map<size_t, void*> freeLists_;
+};
+
+// Return type of a scripted updator. Scripts are free functions whose first
+// parameter is the ScriptScheduler that runs them, which is where their
+// coroutine frame is allocated:
+//
+//   UpdateScript blink(ScriptScheduler& scripts, uint8_t color) {
+//       while (true) {
+//           scripts.write(BufferIndex::PPU, paletteOffset, color);
+//           co_await scripts.frames(8);
+//           scripts.write(BufferIndex::PPU, paletteOffset, uint8_t(0x0F));
+//           co_await scripts.frames(8);
+//       }
+//   }
+class UpdateScript {
+public:
+    struct promise_type {
+        template<typename... Args>
+        static void* operator new(size_t size, ScriptScheduler& scheduler, Args&&...);
+
+        static void operator delete(void* ptr, size_t size);
+
+        UpdateScript get_return_object() {
+            return UpdateScript(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        // Scripts first run on the frame after they're started
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        std::suspend_always final_suspend() noexcept {
+            return {};
+        }
+
+        void return_void() {}
+
+        void unhandled_exception() {
+            exception = std::current_exception();
+        }
+
+        std::exception_ptr exception;
+    };
+
+    UpdateScript(UpdateScript&& other): handle_(std::exchange(other.handle_, nullptr)) {}
+
+    UpdateScript(const UpdateScript&) = delete;
+    UpdateScript& operator=(const UpdateScript&) = delete;
+
+    ~UpdateScript() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+private:
+    friend class ScriptScheduler;
+
+    explicit UpdateScript(std::coroutine_handle<promise_type> handle): handle_(handle) {}
+
+    std::coroutine_handle<promise_type> release() {
+        return std::exchange(handle_, nullptr);
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+};
+
+// Runs a session's scripts as a single updator. Scripts wait on a number of
+// frames or on a scanline, and the scheduler keeps them ordered by when they
+// wake, so only scripts that are due are resumed & the clock doesn't run the
+// scheduler at all on frames where none are.
+//
+// Scripts write to targets, staging fields added through the scheduler that are
+// copied at a given scanline. A write goes to the target covering its destination
+// at the scanline the script last waited on, so the write lands from that scanline on.
+// Add every target before other staging fields so the scheduler's span stays tight.
+//
+// Coroutine frames can't be saved, so loading a snapshot restarts every script
+// from the frame it was started on & replays it up to the saved frame into
+// scratch memory. Scripts should keep their state in locals rather than read it
+// back out of staging. Loading costs every wake since the scripts started, not
+// since the closest keyframe, so long sessions seek more slowly the further in
+// they are; scripts that wake rarely keep this cheap.
+class ScriptScheduler : public GameClock::UpdateFunction {
+public:
+    using ScriptFactory = std::function<UpdateScript(ScriptScheduler&)>;
+
+    class WakeAwaiter {
+    public:
+        WakeAwaiter(ScriptScheduler& scheduler, long frame, uint scanline)
+        : scheduler_(scheduler), frame_(frame), scanline_(scanline) {}
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<UpdateScript::promise_type> script) {
+            scheduler_.schedule(script, frame_, scanline_);
+        }
+
+        void await_resume() const noexcept {}
+    private:
+        ScriptScheduler& scheduler_;
+        long frame_;
+        uint scanline_;
+    };
+
+    ScriptScheduler();
+
+    ~ScriptScheduler();
+
+    // Adds a staging field copied at the given scanline that scripts can write to
+    void addTarget(MemoryUpdateComposer& composer,
+                   BufferIndex dstBuffer,
+                   size_t dstOffset,
+                   size_t size,
+                   uint scanline,
+                   void* initialValue = nullptr);
+
+    // The script first runs on the next frame, at scanline 0
+    void start(ScriptFactory script);
+
+    // Resumes at scanline 0 of the frame count frames from now, at least 1
+    WakeAwaiter frames(uint count) {
+        return WakeAwaiter(*this, frame_ + std::max(count, 1u), 0);
+    }
+
+    // Resumes later this frame if the scanline is still ahead, otherwise next frame
+    WakeAwaiter scanline(uint scanline) {
+        return WakeAwaiter(*this, scanline > scanline_ ? frame_ : frame_ + 1, scanline);
+    }
+
+    template<typename T>
+    void write(BufferIndex dstBuffer, size_t dstOffset, const T& value) {
+        memcpy(getTarget(dstBuffer, dstOffset, sizeof(T)), &value, sizeof(T));
+    }
+
+    // Staging bytes copied to the destination at the current scanline, throws if
+    // no target covers them
+    uint8_t* getTarget(BufferIndex dstBuffer, size_t dstOffset, size_t size);
+
+    long getFrame() const {
+        return frame_;
+    }
+
+    uint getScanline() const {
+        return scanline_;
+    }
+
+    ScriptArena& getArena() {
+        return arena_;
+    }
+
+    void execute(void* mappedData) override;
+
+    void saveState(StateWriter& writer) const override;
+
+    void loadState(StateReader& reader) override;
+
+protected:
+    uint getFrequency() const override {
+        // The clock runs the scheduler exactly when the earliest script wakes
+        return due_.empty() ? UINT_MAX : static_cast<uint>(due_.top().frame - frame_);
+    }
+
+private:
+    struct Target {
+        BufferIndex dstBuffer;
+        size_t dstOffset;
+        size_t size;
+        uint scanline;
+        // Relative to the start of the span
+        size_t spanOffset;
+    };
+
+    struct StartedScript {
+        long frame;
+        ScriptFactory factory;
+        // Started by another script, so replaying that one starts it again
+        bool byScript;
+    };
+
+    struct Wake {
+        long frame;
+        uint scanline;
+        // Scripts waking together run in the order they went to sleep
+        uint64_t order;
+        std::coroutine_handle<UpdateScript::promise_type> script;
+
+        bool operator>(const Wake& other) const {
+            if (frame != other.frame) {
+                return frame > other.frame;
+            }
+            if (scanline != other.scanline) {
+                return scanline > other.scanline;
+            }
+            return order > other.order;
+        }
+    };
+
+    void schedule(std::coroutine_handle<UpdateScript::promise_type> script, long frame, uint scanline);
+
+    // Resumes every script due at or before the given frame
+    void runUntil(long frame);
+
+    void destroyScripts();
+
+private:
+    // Declared first so it outlives the coroutine frames it holds
+    ScriptArena arena_;
+
+    std::vector<Target> targets_;
+    std::vector<StartedScript> started_;
+    std::priority_queue<Wake, std::vector<Wake>, std::greater<Wake>> due_;
+    uint64_t nextOrder_ = 0;
+
+    // Frame the scheduler last ran on, & the scanline of the script being resumed
+    long frame_ = 0;
+    uint scanline_ = 0;
+    uint8_t* span_ = nullptr;
+    bool resuming_ = false;
+};
+
+template<typename... Args>
+void* UpdateScript::promise_type::operator new(size_t size, ScriptScheduler& scheduler, Args&&...) {
+    // The arena is kept in front of the frame so it can be found again on delete
+    auto* block = static_cast<std::byte*>(scheduler.getArena().allocate(size + ScriptArena::ALIGNMENT));
+    *reinterpret_cast<ScriptArena**>(block) = &scheduler.getArena();
+    return block + ScriptArena::ALIGNMENT;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Appends plain values & byte ranges to a state blob
+class StateWriter {
+public:
+    template<typename T>
+    void write(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        writeBytes(&value, sizeof(T));
+    }
+
+    void writeBytes(const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        data_.insert(data_.end(), bytes, bytes + size);
+    }
+
+    // Length prefixed, so the reader can check it against what it expects
+    template<typename T>
+    void writeVector(const std::vector<T>& values) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        write<uint64_t>(values.size());
+        writeBytes(values.data(), values.size() * sizeof(T));
+    }
+
+    const std::vector<uint8_t>& getData() const {
+        return data_;
+    }
+
+private:
+    std::vector<uint8_t> data_;
+};
+
+// Reads values back in the order a StateWriter wrote them, throwing on truncated state
+class StateReader {
+public:
+    StateReader(const std::vector<uint8_t>& data): data_(data) {}
+
+    template<typename T>
+    void read(T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        readBytes(&value, sizeof(T));
+    }
+
+    void readBytes(void* data, size_t size) {
+        if (size > data_.size() - offset_) {
+            throw std::runtime_error("snapshot state is truncated");
+        }
+        memcpy(data, data_.data() + offset_, size);
+        offset_ += size;
+    }
+
+    template<typename T>
+    void readVector(std::vector<T>& values) {
+        uint64_t size;
+        read(size);
+        if (size > (data_.size() - offset_) / sizeof(T)) {
+            throw std::runtime_error("snapshot state is truncated");
+        }
+        values.resize(size);
+        readBytes(values.data(), size * sizeof(T));
+    }
+
+private:
+    const std::vector<uint8_t>& data_;
+    size_t offset_ = 0;
+};
+
+// Everything needed to resume a session at the start of a given clock frame
+struct SessionSnapshot {
+    static constexpr uint32_t MAGIC = 0x53555050; // "PPUS"
+    static constexpr uint32_t VERSION = 1;
+
+    uint64_t frame = 0;
+    // Contents of the GPU memory buffers
+    std::vector<uint8_t> ppu;
+    std::vector<uint8_t> oam;
+    std::vector<uint8_t> control;
+    // Staging buffer, as last written by the clock updators
+    std::vector<uint8_t> staging;
+    // GameClock::saveState
+    std::vector<uint8_t> clockState;
+
+    // Little endian header (magic, version, frame) followed by each field as a
+    // 64 bit length & its bytes, in declaration order
+    void writeToFile(const std::string& path) const;
+    static SessionSnapshot readFromFile(const std::string& path);
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "GameClock.h"
+#include "PpuComputeNode.h"
+#include "SessionSnapshot.h"
+
+// GPU buffer captured in snapshots, needs VK_BUFFER_USAGE_TRANSFER_SRC_BIT & TRANSFER_DST_BIT
+struct SnapshotBuffer {
+    VkBuffer buffer;
+    size_t size;
+};
+
+// Records a snapshot every keyframeInterval clock frames so that seeking only
+// replays the updators from the closest keyframe, rather than from frame 0.
+// Replaying relies on updators being deterministic. The clock's starting frame
+// is always a keyframe, taken from the memory the buffers were created with.
+//
+// GPU buffers are never read or written while the device waits. A keyframe's
+// buffers are copied out ahead of the frame's updates & read back once that
+// frame's fence has been waited on, and a restore is copied in at the same point.
+// Must be added to the compute node as a scanline pass.
+class SessionTimeline : public ScanlinePass {
+public:
+    SessionTimeline(VulkanApp<F>& app,
+                    GameClock& clock,
+                    Buffer<uint8_t>& stagingBuffer,
+                    size_t stagingSize,
+                    std::array<SnapshotBuffer, 3> memoryBuffers,
+                    std::array<std::vector<uint8_t>, 3> initialMemory,
+                    uint keyframeInterval,
+                    PpuProfiler* profiler = nullptr);
+
+    // Pre-draw callback, must run after the clock's
+    std::shared_ptr<std::function<void(VulkanApp<F>&,uint32_t)>>& getCallback() {
+        return callback_;
+    }
+
+    // Seeks before the next frame is rendered, safe to call from any thread.
+    // A seek that fails leaves the session running & is reported by takeSeekError.
+    void requestSeek(uint64_t frame) {
+        pendingSeek_ = frame;
+    }
+
+    // Why the last failed requested seek failed, empty if none has since the last call
+    std::string takeSeekError();
+
+    // Restores the closest keyframe at or before frame & steps the clock forward to it.
+    // Only call between frames on the render thread.
+    void seek(uint64_t frame);
+
+    // Staging memory & the clock are restored right away, the GPU buffers
+    // ahead of the next frame's updates
+    void restore(const SessionSnapshot& snapshot);
+
+    const std::map<uint64_t, SessionSnapshot>& getKeyframes() const {
+        return keyframes_;
+    }
+
+    void recordBeforeUpdates(VkCommandBuffer commandBuffer, uint32_t frameIndex) override;
+
+    void recordBeforeDispatch(VkCommandBuffer, uint32_t, uint) override {}
+
+private:
+    void onFrame();
+
+    // Frame number, staging memory & clock state, everything but the GPU buffers
+    SessionSnapshot captureHostState();
+
+    // Completes the pending keyframe with the buffers copied out last frame
+    void finishCapture();
+
+private:
+    static constexpr int64_t NO_SEEK = -1;
+
+    VulkanApp<F>& app_;
+    GameClock& clock_;
+    Buffer<uint8_t>& stagingBuffer_;
+    size_t stagingSize_;
+    std::array<SnapshotBuffer, 3> memoryBuffers_;
+    uint keyframeInterval_;
+    PpuProfiler* profiler_;
+
+    // Host visible copies of the memory buffers, by BufferIndex
+    std::array<std::unique_ptr<Buffer<uint8_t>>, 3> readbackBuffers_;
+    std::array<std::unique_ptr<Buffer<uint8_t>>, 3> uploadBuffers_;
+
+    // Keyframe waiting on its GPU buffers, which are copied out once recorded
+    std::optional<SessionSnapshot> pendingCapture_;
+    bool captureRecorded_ = false;
+    bool restorePending_ = false;
+
+    std::map<uint64_t, SessionSnapshot> keyframes_;
+    std::atomic<int64_t> pendingSeek_ = NO_SEEK;
+    std::mutex seekErrorMutex_;
+    std::string seekError_;
+
+    std::shared_ptr<std::function<void(VulkanApp<F>&,uint32_t)>> callback_;
+};
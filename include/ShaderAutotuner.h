@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "NesFrameTracker.h"
+
+// A build of nes.comp, named by the features appended to its spirv path
+struct ShaderVariant {
+    std::vector<std::string> features;
+    uint linesPerGroup;
+    bool needsSubgroupBallot;
+
+    // Such as nes_subgroup_lines4, or nes for the plain shader
+    std::string getName() const;
+};
+
+struct VariantTiming {
+    ShaderVariant variant;
+    // Fastest of the measured rounds for each of ShaderAutotuner::BATCH_SCANLINES
+    std::vector<double> microsPerBatch;
+    // Time relative to the plain shader, averaged over the batch sizes
+    double score;
+    // Rendered the same frame as the plain shader
+    bool matches;
+};
+
+// Picks the fastest nes.comp variant for the current device & remembers it.
+// Choices are kept per device & driver in a small text file, one
+// "<vendor> <device> <driver> <variant>" line each, so tuning only runs again
+// when the hardware, the driver or the set of variants changes.
+class ShaderAutotuner {
+public:
+    // Batch sizes every variant is timed at, a whole frame first. Incremental
+    // rendering & raster splits dispatch short batches, where fewer lines per
+    // group can win even when more win on whole frames.
+    static constexpr std::array<uint, 3> BATCH_SCANLINES = {SCANLINES, 8, 1};
+
+    // apiVersion VulkanApp creates its instance with, which it doesn't report back.
+    // Subgroup variants are skipped until it requests 1.1.
+    static constexpr uint32_t INSTANCE_API_VERSION = VK_API_VERSION_1_0;
+
+    ShaderAutotuner(VulkanApp<F>& app, const std::string& cachePath);
+
+    static const std::vector<ShaderVariant>& getVariants();
+
+    // The persisted choice for this device, benchmarking & persisting one if there is none
+    ShaderVariant select(const NesMemoryState& sample);
+
+    // Renders the sample with every variant the device supports, at every batch size.
+    // Timings run in the order of getVariants, so the plain shader always comes first.
+    std::vector<VariantTiming> benchmark(const NesMemoryState& sample, uint rounds = 8);
+
+    // Records the choice for this device, replacing any earlier one
+    void persist(const ShaderVariant& variant);
+
+private:
+    bool supportsSubgroupBallot() const;
+    std::string getDeviceKey() const;
+
+private:
+    VulkanApp<F>& app_;
+    std::string cachePath_;
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Single-producer/single-consumer ring of frame messages in POSIX shared
+// memory, written by an emulator process and read by a session.
+//
+// Layout: ShmFeedHeader, then slotCount slots of slotSize bytes. Each slot
+// holds one FeedFrameHeader followed by recordCount records, where a record
+// is a FeedRecord followed by its bytes padded to 4.
+
+// Buffer ids used by records, matching BufferIndex
+enum FeedBuffer : uint8_t {
+    FEED_PPU = 0,
+    FEED_OAM = 1,
+    FEED_CONTROL = 2
+};
+
+enum FeedRecordKind : uint8_t {
+    // Bytes for a buffer, applied before the frame starts & kept for later frames
+    FEED_DELTA = 0,
+    // Bytes for the Control buffer, applied at a scanline of this frame only
+    FEED_SCANLINE_WRITE = 1
+};
+
+struct ShmFeedHeader {
+    static constexpr uint32_t MAGIC = 0x44454546; // "FEED"
+    static constexpr uint32_t VERSION = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t slotSize;
+    // Kept on separate cache lines so the two processes don't contend
+    alignas(64) std::atomic<uint64_t> writeIndex;
+    alignas(64) std::atomic<uint64_t> readIndex;
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+struct FeedFrameHeader {
+    uint64_t frame;
+    uint32_t recordCount;
+    uint32_t payloadSize;
+};
+
+struct FeedRecord {
+    FeedRecordKind kind;
+    FeedBuffer buffer;
+    uint16_t scanline;
+    uint32_t offset;
+    uint32_t size;
+};
+
+// Mapping of the shared ring, either created by the producer or attached to by the consumer
+class ShmFeedRing {
+public:
+    // The producer owns the shared memory object & unlinks it when destroyed
+    static std::unique_ptr<ShmFeedRing> create(const std::string& name, uint32_t slotCount, uint32_t slotSize);
+
+    static std::unique_ptr<ShmFeedRing> attach(const std::string& name);
+
+    ~ShmFeedRing();
+
+    ShmFeedRing(const ShmFeedRing&) = delete;
+    ShmFeedRing& operator=(const ShmFeedRing&) = delete;
+
+    uint32_t getSlotSize() const {
+        return header_->slotSize;
+    }
+
+    // Producer side, returns nullptr when the ring is full
+    uint8_t* beginWrite();
+    void endWrite();
+
+    // Consumer side, returns nullptr when the ring is empty
+    const uint8_t* beginRead();
+    void endRead();
+
+private:
+    ShmFeedRing(const std::string& name, void* mapping, size_t mappingSize, bool owner);
+
+    uint8_t* slot(uint64_t index) const;
+
+private:
+    std::string name_;
+    void* mapping_;
+    size_t mappingSize_;
+    bool owner_;
+    ShmFeedHeader* header_;
+    uint8_t* slots_;
+};
+
+// Builds a frame message in place inside a ring slot
+class FeedFrameWriter {
+public:
+    FeedFrameWriter(uint8_t* slot, size_t slotSize, uint64_t frame);
+
+    // Each returns false, leaving the message as it was, if the slot is full
+    bool addDelta(FeedBuffer buffer, uint32_t offset, const void* data, uint32_t size);
+    bool addScanlineWrite(uint16_t scanline, uint32_t offset, const void* data, uint32_t size);
+
+private:
+    bool addRecord(const FeedRecord& record, const void* data);
+
+private:
+    FeedFrameHeader* header_;
+    uint8_t* payload_;
+    size_t capacity_;
+};
+
+// Walks the records of a frame message. Payload pointers point into the slot.
+class FeedFrameReader {
+public:
+    FeedFrameReader(const uint8_t* slot, size_t slotSize);
+
+    uint64_t getFrame() const {
+        return header_->frame;
+    }
+
+    // Returns false once every record has been read, throws on a malformed message
+    bool next(FeedRecord& record, const uint8_t*& data);
+
+private:
+    const FeedFrameHeader* header_;
+    const uint8_t* payload_;
+    size_t payloadSize_;
+    size_t offset_ = 0;
+    uint32_t recordsRead_ = 0;
+};
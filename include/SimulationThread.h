@@ -0,0 +1,55 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include "GameClock.h"
+#include "TripleBuffer.h"
+
+// Runs a GameClock on its own thread at 60Hz, so updator cost never adds to
+// frame latency & a slow present never holds up animation. Updators write a
+// private copy of staging memory, which is copied whole into the back of a
+// triple buffer of staging buffers & published after every step. The render
+// thread copies out of the newest published snapshot when its frame starts.
+class SimulationThread {
+public:
+    SimulationThread(VulkanApp<F>& app,
+                     const std::vector<uint8_t>& initialStaging,
+                     UpdateList&& updators,
+                     uint updatorThreads = 1,
+                     PpuProfiler* profiler = nullptr);
+
+    ~SimulationThread();
+
+    // Render thread only. Swaps in the newest snapshot, which is left alone
+    // by the simulation until the next call, so it must outlive the frame's copies.
+    Buffer<uint8_t>& acquireLatest();
+
+    Buffer<uint8_t>& getFront() {
+        return *snapshots_.getFront();
+    }
+
+    // Clock frame of the newest published snapshot
+    long getPublishedFrame() const {
+        return publishedFrame_.load(std::memory_order_relaxed);
+    }
+
+private:
+    void run();
+
+private:
+    std::vector<uint8_t> working_;
+    std::unique_ptr<GameClock> clock_;
+    TripleBuffer<std::unique_ptr<Buffer<uint8_t>>> snapshots_;
+    std::atomic<long> publishedFrame_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::exception_ptr error_;
+    std::atomic<bool> failed_ = false;
+
+    std::thread thread_;
+};
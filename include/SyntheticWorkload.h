@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "GameClock.h"
+#include "NesMemory.h"
+
+// Knobs of a generated session, each scaling one kind of per-frame work
+struct SyntheticWorkloadConfig {
+    // Scanlines that change the horizontal scroll mid-frame, each splitting the frame into another batch
+    uint rasterSplits = 0;
+    // Sprites whose OAM entries are rewritten every frame
+    uint oamChurn = 0;
+    // Updators writing into the nametables every frame, & the bytes each one writes
+    uint updatorCount = 1;
+    uint updatorBytes = 4;
+    // Tiles at the end of the first pattern table that are rotated every 8 frames, like Batman's
+    uint animatedTiles = 0;
+    // Independent sessions, each with its own memory & updators
+    uint sessionCount = 1;
+    uint32_t seed = 1;
+};
+
+// Generates parameterized NES sessions for benchmarking, without any dumps.
+// Memory is filled from a seeded generator so runs are repeatable.
+class SyntheticWorkload {
+public:
+    explicit SyntheticWorkload(const SyntheticWorkloadConfig& config);
+
+    const SyntheticWorkloadConfig& getConfig() const {
+        return config_;
+    }
+
+    // Starting memory of the given session
+    nes::PPUMemory getPpuMemory(uint session) const;
+    nes::OAM getOam(uint session) const;
+    nes::Control getControl() const;
+
+    // Adds the session's staging fields & returns its updators
+    UpdateList composeUpdates(uint session, MemoryUpdateComposer& composer) const;
+
+    // As above, with the session's starting memory already generated
+    UpdateList composeUpdates(uint session,
+                              MemoryUpdateComposer& composer,
+                              const nes::PPUMemory& ppu,
+                              const nes::OAM& oam) const;
+
+private:
+    SyntheticWorkloadConfig config_;
+};
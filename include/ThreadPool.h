@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Constants.h"
+
+// Fixed set of worker threads for fork/join style loops
+class ThreadPool {
+public:
+    // threadCount includes the calling thread, so 1 runs everything inline
+    explicit ThreadPool(uint threadCount);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Calls task(i) for every i in [0, count) and returns once all have finished.
+    // The calling thread works through tasks alongside the workers.
+    void parallelFor(size_t count, const std::function<void(size_t)>& task);
+
+    uint getThreadCount() const {
+        return workers_.size() + 1;
+    }
+
+private:
+    void workerLoop();
+
+    // Runs tasks until none are left
+    void drain(const std::function<void(size_t)>& task, size_t count);
+
+private:
+    std::vector<std::thread> workers_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+
+    // Guarded by mutex_
+    const std::function<void(size_t)>* task_ = nullptr;
+    size_t taskCount_ = 0;
+    size_t pendingTasks_ = 0;
+    uint activeWorkers_ = 0;
+    uint64_t generation_ = 0;
+    bool stopping_ = false;
+
+    std::atomic<size_t> nextTask_ = 0;
+};
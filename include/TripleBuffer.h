@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Lock-free handoff of the newest value from one producer thread to one
+// consumer thread. The producer fills the back slot & publishes it, the
+// consumer swaps the newest published slot to the front. Neither side ever
+// waits, and the producer never touches the slot the consumer holds.
+template<typename T>
+class TripleBuffer {
+    // Set on the middle index when it holds a value the consumer hasn't seen
+    static constexpr uint8_t FRESH = 0x4;
+public:
+    TripleBuffer() = default;
+
+    explicit TripleBuffer(std::array<T, 3>&& slots): slots_(std::move(slots)) {}
+
+    // Producer side
+    T& getBack() {
+        return slots_[back_];
+    }
+
+    void publish() {
+        back_ = middle_.exchange(back_ | FRESH, std::memory_order_acq_rel) & ~FRESH;
+    }
+
+    // Consumer side, returns whether the front changed
+    bool acquire() {
+        if ((middle_.load(std::memory_order_relaxed) & FRESH) == 0) {
+            return false;
+        }
+        front_ = middle_.exchange(front_, std::memory_order_acq_rel) & ~FRESH;
+        return true;
+    }
+
+    T& getFront() {
+        return slots_[front_];
+    }
+
+    // Unsynchronized access for setting up every slot before the threads start
+    std::array<T, 3>& getSlots() {
+        return slots_;
+    }
+
+private:
+    std::array<T, 3> slots_;
+    uint8_t back_ = 0;
+    std::atomic<uint8_t> middle_ = 1;
+    uint8_t front_ = 2;
+};
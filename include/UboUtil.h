@@ -1,17 +1,19 @@
 #pragma once
 
 #include "PpuComputeNode.h"
+#include "NesMemory.h"
 #include <VulkanApp.h>
 
 static const std::string pathPrefix = "/Users/zyoussef/code/ppu/";
 
 template<typename T>
 std::unique_ptr<Buffer<T>> createUboFromStruct(T t, VulkanApp<F>& app, 
-                                              VkMemoryPropertyFlags memFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) {
+                                              VkMemoryPropertyFlags memFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                              VkBufferUsageFlags extraUsage = 0) {
     std::unique_ptr<Buffer<T>> ubo;
     Buffer<T>::createAndInitialize(ubo, 
                                    {t}, 
-                                   VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 
+                                   VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | extraUsage, 
                                    memFlags,
                                    app.getDevice(), 
                                    app.getPhysicalDevice(), 
@@ -21,12 +23,28 @@ std::unique_ptr<Buffer<T>> createUboFromStruct(T t, VulkanApp<F>& app,
 }
 
 template<typename T>
-std::unique_ptr<Buffer<T>> createUboFromFile(const std::string& path, VulkanApp<F>& app) {
+T readStructFromFile(const std::string& path) {
     std::ifstream dumpFile(pathPrefix + path, std::ios::binary);
     std::vector<uint8_t> buffer(std::istreambuf_iterator<char>(dumpFile), {});
     T memStruct;
     std::memcpy(&memStruct, buffer.data(), sizeof(T));
+    return memStruct;
+}
 
+template<typename T>
+std::unique_ptr<Buffer<T>> createUboFromFile(const std::string& path, VulkanApp<F>& app) {
     // Upload PPU memory to a uniform buffer
-    return createUboFromStruct<T>(memStruct, app);
+    return createUboFromStruct<T>(readStructFromFile<T>(path), app);
+}
+
+// Binds NES PPU memory for a compute shader, nes::PackedPPUMemory when compactMemory is set
+inline std::shared_ptr<Descriptor> createPpuMemoryDescriptor(VkBuffer ppuBuffer, bool compactMemory) {
+    if (compactMemory) {
+        return std::make_shared<UniformBufferDescriptor<nes::PackedPPUMemory, F>>(
+            std::array<VkBuffer, F>{ppuBuffer},
+            VK_SHADER_STAGE_COMPUTE_BIT);
+    }
+    return std::make_shared<UniformBufferDescriptor<nes::PPUMemory, F>>(
+        std::array<VkBuffer, F>{ppuBuffer},
+        VK_SHADER_STAGE_COMPUTE_BIT);
 }
\ No newline at end of file
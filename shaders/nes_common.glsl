@@ -0,0 +1,87 @@
+// Shared NES memory layout & helpers
+// Requires GL_EXT_scalar_block_layout and the explicit 8/16 bit type extensions
+
+// Memory Layout Struct Definitions ----------------------------------
+
+struct Tile {
+    uint8_t plane0[8];
+    uint8_t plane1[8];
+} tile;
+
+struct TileSet {
+    Tile tiles[256];
+} tileSet;
+
+struct NameTable {
+    uint8_t tileIndices[960];
+    uint8_t attributeTable[64];
+} nameTable;
+
+struct Palette {
+    uint8_t data[4];
+} palette;
+
+struct Sprite {
+    uint8_t y;
+    uint8_t tileIndex;
+    uint8_t attr;
+    uint8_t x;
+} sprite;
+
+// -------------------------------------------------------------------
+// PPU Memory --------------------------------------------------------
+// -------------------------------------------------------------------
+
+#ifdef COMPACT_MEMORY
+// nes::PackedPPUMemory, only the two nametables the cartridge backs
+layout(std430, binding = 0) uniform readonly PPUMemory {
+    TileSet tileSets[2];
+    Palette backgroundPalettes[4];
+    Palette spritePalettes[4];
+    uint8_t nametableMap[4];
+    uint8_t padding[12];
+    NameTable nameTables[2];
+} memory;
+
+// Physical nametable backing one of the four the PPU addresses
+#define PHYSICAL_NAMETABLE(i) uint(memory.nametableMap[(i)])
+#else
+layout(std430, binding = 0) uniform readonly PPUMemory {
+    TileSet tileSets[2];
+    NameTable nameTables[4];
+    uint8_t padding0[3840];
+    Palette backgroundPalettes[4];
+    Palette spritePalettes[4];
+    uint8_t padding1[224];
+} memory;
+
+#define PHYSICAL_NAMETABLE(i) (i)
+#endif
+
+// -------------------------------------------------------------------
+// Unpack Helpers ----------------------------------------------------
+// -------------------------------------------------------------------
+
+uint unpack2BitsFromByte(uint8_t packed, uint byteIdx) {
+    // Assumes data is stored like
+    // 33221100
+    uint shiftDistance = (2 * byteIdx);
+    uint mask = 0x03 << shiftDistance;
+    return (packed & mask) >> shiftDistance;
+}
+
+uint unpackBitFromByte(uint8_t packed, uint byteIdx) {
+    // Assumes data is stored like
+    // 01234567
+    uint shiftDistance = 7 - byteIdx;
+    uint mask = 0x1 << shiftDistance;
+    return (packed & mask) >> shiftDistance;
+}
+
+uint sampleTile(Tile tile, uint x, uint y) {
+    uint xIntoTile = x % 8;
+    uint yIntoTile = y % 8;
+    uint lowBit = unpackBitFromByte(tile.plane0[yIntoTile], xIntoTile);
+    uint highBit = unpackBitFromByte(tile.plane1[yIntoTile], xIntoTile);
+    return (highBit << 1) | lowBit;
+}
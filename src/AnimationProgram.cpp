@@ -0,0 +1,385 @@
+#include "AnimationProgram.h"
+#include "UboUtil.h"
+
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+    // Tokens of a single line, with errors reported against the line number
+    class LineReader {
+    public:
+        LineReader(const std::string& path, uint lineNumber, const std::string& line)
+        : path_(path), lineNumber_(lineNumber), stream_(line) {}
+
+        bool done() {
+            stream_ >> std::ws;
+            return stream_.eof();
+        }
+
+        std::string word() {
+            std::string token;
+            if (!(stream_ >> token)) {
+                fail("unexpected end of line");
+            }
+            return token;
+        }
+
+        // Accepts decimal or 0x prefixed hex
+        uint number() {
+            std::string token = word();
+            // stoul would wrap negative numbers around
+            if (token.find('-') != std::string::npos) {
+                fail(std::format("expected a non-negative number, found '{}'", token));
+            }
+            size_t parsed = 0;
+            unsigned long value = 0;
+            try {
+                value = std::stoul(token, &parsed, 0);
+            } catch (const std::out_of_range&) {
+                fail(std::format("{} is too large", token));
+            } catch (const std::exception&) {
+                parsed = 0;
+            }
+            if (parsed != token.size()) {
+                fail(std::format("expected a number, found '{}'", token));
+            }
+            if (value > std::numeric_limits<uint>::max()) {
+                fail(std::format("{} is too large", token));
+            }
+            return value;
+        }
+
+        uint8_t byte() {
+            uint value = number();
+            if (value > 0xFF) {
+                fail(std::format("{} does not fit in a byte", value));
+            }
+            return value;
+        }
+
+        [[noreturn]] void fail(const std::string& message) const {
+            throw std::runtime_error(std::format("{}:{}: {}", path_, lineNumber_, message));
+        }
+
+    private:
+        const std::string& path_;
+        uint lineNumber_;
+        std::istringstream stream_;
+    };
+
+    std::vector<uint8_t> readBytes(const std::string& path) {
+        std::ifstream file(pathPrefix + path, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error(std::format("failed to open {}", path));
+        }
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {});
+    }
+
+    // An animation as written in the file, before offsets are made span relative
+    struct ParsedAnimation {
+        std::string kind;
+        std::string regionName;
+        StagingRegionHandle region;
+        uint period = 1;
+        std::unordered_map<std::string, std::vector<uint>> fields;
+        std::vector<std::pair<uint8_t, uint8_t>> mapping;
+        std::vector<uint8_t> ramp;
+        std::string file;
+    };
+}
+
+UpdateList AnimationProgram::load(const std::string& path, const RegionBindings& regions) {
+    std::ifstream file(pathPrefix + path);
+    if (!file) {
+        throw std::runtime_error(std::format("failed to open {}", path));
+    }
+
+    std::vector<ParsedAnimation> parsed;
+    std::vector<uint> lineNumbers;
+    std::string line;
+    for (uint lineNumber = 1; std::getline(file, line); ++lineNumber) {
+        line = line.substr(0, line.find('#'));
+        LineReader reader(path, lineNumber, line);
+        if (reader.done()) {
+            continue;
+        }
+
+        ParsedAnimation animation;
+        animation.kind = reader.word();
+        if (animation.kind != "tiles" && animation.kind != "position"
+            && animation.kind != "palette" && animation.kind != "bank") {
+            reader.fail(std::format("unknown animation kind '{}'", animation.kind));
+        }
+        animation.regionName = reader.word();
+        if (regions.find(animation.regionName) == regions.end()) {
+            reader.fail(std::format("region '{}' is not bound", animation.regionName));
+        }
+        animation.region = regions.at(animation.regionName);
+
+        while (!reader.done()) {
+            std::string key = reader.word();
+            if (key == "every") {
+                animation.period = reader.number();
+                if (animation.period == 0) {
+                    reader.fail("period must be at least one frame");
+                }
+            } else if (key == "step" || key == "wrap") {
+                animation.fields[key] = {reader.number(), reader.number()};
+            } else if (key == "map") {
+                // Pairs run to the end of the line
+                while (!reader.done()) {
+                    std::string pair = reader.word();
+                    size_t colon = pair.find(':');
+                    if (colon == std::string::npos) {
+                        reader.fail(std::format("expected from:to, found '{}'", pair));
+                    }
+                    LineReader from(path, lineNumber, pair.substr(0, colon));
+                    LineReader to(path, lineNumber, pair.substr(colon + 1));
+                    animation.mapping.emplace_back(from.byte(), to.byte());
+                }
+            } else if (key == "ramp") {
+                while (!reader.done()) {
+                    animation.ramp.push_back(reader.byte());
+                }
+            } else if (key == "file") {
+                animation.file = reader.word();
+            } else {
+                animation.fields[key] = {reader.number()};
+            }
+        }
+
+        parsed.push_back(std::move(animation));
+        lineNumbers.push_back(lineNumber);
+    }
+
+    if (parsed.empty()) {
+        throw std::runtime_error(std::format("{}: no animations", path));
+    }
+
+    // Each updator maps only its own region, rather than everything between them
+    std::vector<std::unique_ptr<AnimationProgram>> programs;
+    std::unordered_map<std::string, AnimationProgram*> programsByRegion;
+
+    for (size_t i = 0; i < parsed.size(); ++i) {
+        const auto& animation = parsed[i];
+        LineReader errors(path, lineNumbers[i], "");
+        AnimationProgram*& program = programsByRegion[animation.regionName];
+        if (program == nullptr) {
+            programs.emplace_back(new AnimationProgram(animation.region));
+            program = programs.back().get();
+        }
+        auto field = [&](const std::string& key, uint fallback) {
+            auto it = animation.fields.find(key);
+            return it == animation.fields.end() ? fallback : it->second[0];
+        };
+        auto pairField = [&](const std::string& key, std::pair<uint, uint> fallback) {
+            auto it = animation.fields.find(key);
+            return it == animation.fields.end() ? fallback : std::pair{it->second[0], it->second[1]};
+        };
+
+        uint32_t regionSize = animation.region.size;
+
+        if (animation.kind == "tiles" || animation.kind == "position") {
+            uint stride = field("stride", 1);
+            if (stride == 0) {
+                errors.fail("stride must be at least one byte");
+            }
+            uint count = field("count", regionSize / stride);
+            auto inRegion = [&](uint offset) {
+                if (count == 0 || (count - 1) * stride + offset >= regionSize) {
+                    errors.fail("entries run past the end of the region");
+                }
+            };
+
+            if (animation.kind == "tiles") {
+                uint offset = field("offset", 0);
+                inRegion(offset);
+
+                // Bytes without a mapping are left as they are
+                std::array<uint8_t, 256> lookup;
+                for (uint value = 0; value < 256; ++value) {
+                    lookup[value] = value;
+                }
+                for (auto [from, to] : animation.mapping) {
+                    lookup[from] = to;
+                }
+
+                auto& tiles = program->tileCycles_;
+                tiles.lookup.push_back(lookup);
+                tiles.firstByte.push_back(offset);
+                tiles.count.push_back(count);
+                tiles.stride.push_back(stride);
+                tiles.period.push_back(animation.period);
+                tiles.lastFrame.push_back(0);
+            } else {
+                uint xOffset = field("x", 0);
+                uint yOffset = field("y", 0);
+                inRegion(xOffset);
+                inRegion(yOffset);
+                auto [xStep, yStep] = pairField("step", {0, 0});
+                auto [xWrap, yWrap] = pairField("wrap", {256, 256});
+                if (xWrap == 0 || yWrap == 0) {
+                    errors.fail("wrap must be at least one");
+                }
+
+                auto& positions = program->positionTracks_;
+                positions.firstEntry.push_back(0);
+                positions.count.push_back(count);
+                positions.stride.push_back(stride);
+                positions.xOffset.push_back(xOffset);
+                positions.yOffset.push_back(yOffset);
+                positions.xStep.push_back(xStep);
+                positions.yStep.push_back(yStep);
+                positions.xWrap.push_back(xWrap);
+                positions.yWrap.push_back(yWrap);
+                positions.period.push_back(animation.period);
+                positions.lastFrame.push_back(0);
+            }
+        } else if (animation.kind == "palette") {
+            uint offset = field("offset", 0);
+            if (offset >= regionSize) {
+                errors.fail("offset is past the end of the region");
+            }
+            if (animation.ramp.empty()) {
+                errors.fail("palette animations need a ramp");
+            }
+
+            auto& ramps = program->paletteRamps_;
+            ramps.address.push_back(offset);
+            ramps.firstValue.push_back(ramps.values.size());
+            ramps.valueCount.push_back(animation.ramp.size());
+            ramps.nextValue.push_back(0);
+            ramps.values.insert(ramps.values.end(), animation.ramp.begin(), animation.ramp.end());
+            ramps.period.push_back(animation.period);
+            ramps.lastFrame.push_back(0);
+        } else {
+            uint frames = field("frames", 0);
+            uint source = field("source", 0);
+            size_t placeholder = animation.file.find("{}");
+            if (frames == 0 || placeholder == std::string::npos) {
+                errors.fail("bank animations need a file with {} and a frame count");
+            }
+
+            auto& banks = program->tileBanks_;
+            banks.address.push_back(0);
+            banks.size.push_back(regionSize);
+            banks.firstFrame.push_back(banks.data.size());
+            banks.frameCount.push_back(frames);
+            banks.nextFrame.push_back(0);
+            banks.period.push_back(animation.period);
+            banks.lastFrame.push_back(0);
+
+            for (uint frame = 0; frame < frames; ++frame) {
+                std::string framePath = animation.file;
+                framePath.replace(placeholder, 2, std::to_string(frame));
+                auto dump = readBytes(framePath);
+                if (source + regionSize > dump.size()) {
+                    errors.fail(std::format("{} is too small for the region", framePath));
+                }
+                banks.data.insert(banks.data.end(),
+                                  dump.begin() + source,
+                                  dump.begin() + source + regionSize);
+            }
+        }
+    }
+
+    UpdateList updateList;
+    for (auto& program : programs) {
+        updateList.emplace_back(std::move(program));
+    }
+    return updateList;
+}
+
+void AnimationProgram::execute(void* mappedData) {
+    uint8_t* span = (uint8_t*) mappedData;
+    frame_ += 1;
+
+    auto& banks = tileBanks_;
+    for (size_t i = 0; i < banks.address.size(); ++i) {
+        if (!due(frame_, banks.period[i], banks.lastFrame[i])) {
+            continue;
+        }
+        memcpy(span + banks.address[i],
+               banks.data.data() + banks.firstFrame[i] + banks.nextFrame[i] * banks.size[i],
+               banks.size[i]);
+        banks.nextFrame[i] = (banks.nextFrame[i] + 1) % banks.frameCount[i];
+    }
+
+    auto& tiles = tileCycles_;
+    for (size_t i = 0; i < tiles.firstByte.size(); ++i) {
+        if (!due(frame_, tiles.period[i], tiles.lastFrame[i])) {
+            continue;
+        }
+        const uint8_t* lookup = tiles.lookup[i].data();
+        uint8_t* tile = span + tiles.firstByte[i];
+        uint32_t stride = tiles.stride[i];
+        for (uint32_t entry = 0; entry < tiles.count[i]; ++entry, tile += stride) {
+            *tile = lookup[*tile];
+        }
+    }
+
+    auto& positions = positionTracks_;
+    for (size_t i = 0; i < positions.firstEntry.size(); ++i) {
+        if (!due(frame_, positions.period[i], positions.lastFrame[i])) {
+            continue;
+        }
+        uint8_t* entry = span + positions.firstEntry[i];
+        uint32_t stride = positions.stride[i];
+        uint32_t xOffset = positions.xOffset[i];
+        uint32_t yOffset = positions.yOffset[i];
+        uint xStep = positions.xStep[i], xWrap = positions.xWrap[i];
+        uint yStep = positions.yStep[i], yWrap = positions.yWrap[i];
+        for (uint32_t n = 0; n < positions.count[i]; ++n, entry += stride) {
+            entry[xOffset] = (entry[xOffset] + xStep) % xWrap;
+            entry[yOffset] = (entry[yOffset] + yStep) % yWrap;
+        }
+    }
+
+    auto& ramps = paletteRamps_;
+    for (size_t i = 0; i < ramps.address.size(); ++i) {
+        if (!due(frame_, ramps.period[i], ramps.lastFrame[i])) {
+            continue;
+        }
+        span[ramps.address[i]] = ramps.values[ramps.firstValue[i] + ramps.nextValue[i]];
+        ramps.nextValue[i] = (ramps.nextValue[i] + 1) % ramps.valueCount[i];
+    }
+}
+
+void AnimationProgram::saveState(StateWriter& writer) const {
+    GameClock::UpdateFunction::saveState(writer);
+    writer.write(frame_);
+    // Tile & position state lives in the staging memory itself
+    writer.writeVector(tileCycles_.lastFrame);
+    writer.writeVector(positionTracks_.lastFrame);
+    writer.writeVector(paletteRamps_.lastFrame);
+    writer.writeVector(paletteRamps_.nextValue);
+    writer.writeVector(tileBanks_.lastFrame);
+    writer.writeVector(tileBanks_.nextFrame);
+}
+
+void AnimationProgram::loadState(StateReader& reader) {
+    GameClock::UpdateFunction::loadState(reader);
+    reader.read(frame_);
+    size_t tileCount = tileCycles_.lastFrame.size();
+    size_t positionCount = positionTracks_.lastFrame.size();
+    size_t rampCount = paletteRamps_.lastFrame.size();
+    size_t bankCount = tileBanks_.lastFrame.size();
+    reader.readVector(tileCycles_.lastFrame);
+    reader.readVector(positionTracks_.lastFrame);
+    reader.readVector(paletteRamps_.lastFrame);
+    reader.readVector(paletteRamps_.nextValue);
+    reader.readVector(tileBanks_.lastFrame);
+    reader.readVector(tileBanks_.nextFrame);
+    if (tileCycles_.lastFrame.size() != tileCount
+        || positionTracks_.lastFrame.size() != positionCount
+        || paletteRamps_.lastFrame.size() != rampCount
+        || paletteRamps_.nextValue.size() != rampCount
+        || tileBanks_.lastFrame.size() != bankCount
+        || tileBanks_.nextFrame.size() != bankCount) {
+        throw std::runtime_error("snapshot was taken with a different animation file");
+    }
+}
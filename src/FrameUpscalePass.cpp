@@ -0,0 +1,54 @@
+#include "FrameUpscalePass.h"
+#include "UboUtil.h"
+
+#include <VulkanApp.h>
+
+FrameUpscalePass::FrameUpscalePass(VulkanApp<F>& app,
+                                   VkImageView frameView,
+                                   VkImageView upscaledView,
+                                   uint upscaledWidth,
+                                   uint upscaledHeight,
+                                   const UpscaleConfig& config,
+                                   const std::vector<char>& upscaleShaderCode) {
+    paramsUbo_ = createUboFromStruct<UpscaleParams>(UpscaleParams{config.factor, config.filter, {0, 0}}, app);
+
+    upscaleMaterial_ = std::make_unique<UpscaleMat>(app.getDevice(),
+                                                    app.getPhysicalDevice(),
+                                                    std::vector<std::shared_ptr<Descriptor>>{
+                                                    std::make_shared<StorageImageDescriptor<F>>(
+                                                        VK_SHADER_STAGE_COMPUTE_BIT,
+                                                        std::array<VkImageView, F>{frameView}),
+                                                    std::make_shared<StorageImageDescriptor<F>>(
+                                                        VK_SHADER_STAGE_COMPUTE_BIT,
+                                                        std::array<VkImageView, F>{upscaledView}),
+                                                    std::make_shared<UniformBufferDescriptor<UpscaleParams, F>>(
+                                                        std::array<VkBuffer, F>{paramsUbo_->getBuffer()},
+                                                        VK_SHADER_STAGE_COMPUTE_BIT)
+                                                    },
+                                                    upscaleShaderCode,
+                                                    upscaledWidth,
+                                                    upscaledHeight);
+}
+
+FrameUpscalePass::~FrameUpscalePass() = default;
+
+void FrameUpscalePass::recordAfterFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+    // Every batch's writes to the frame have to land first
+    VkMemoryBarrier frameBarrier{};
+    frameBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    frameBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    frameBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 1, &frameBarrier, 0, nullptr, 0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, upscaleMaterial_->getPipeline());
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            upscaleMaterial_->getPipelineLayout(),
+                            0, 1,
+                            upscaleMaterial_->getDescriptorSet(frameIndex),
+                            0, 0);
+    auto dispatchSize = upscaleMaterial_->getDispatchDimensions();
+    vkCmdDispatch(commandBuffer, dispatchSize.x, dispatchSize.y, dispatchSize.z);
+}
@@ -0,0 +1,342 @@
+#include "FrameUpscaler.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace {
+    // One pixel at a time, for the ends of rows & targets without SIMD
+    struct ScalarLanes {
+        using Pixels = uint32_t;
+        static const uint COUNT = 1;
+
+        static Pixels load(const uint32_t* p) {
+            return *p;
+        }
+        static Pixels equal(Pixels a, Pixels b) {
+            return a == b ? ~0u : 0u;
+        }
+        static Pixels either(Pixels a, Pixels b) {
+            return a | b;
+        }
+        // x where mask is clear
+        static Pixels unless(Pixels mask, Pixels x) {
+            return x & ~mask;
+        }
+        static Pixels select(Pixels mask, Pixels a, Pixels b) {
+            return (a & mask) | (b & ~mask);
+        }
+        static void store(uint32_t* p, Pixels a) {
+            *p = a;
+        }
+        static void store2(uint32_t* p, Pixels a, Pixels b) {
+            p[0] = a;
+            p[1] = b;
+        }
+        static void store3(uint32_t* p, Pixels a, Pixels b, Pixels c) {
+            p[0] = a;
+            p[1] = b;
+            p[2] = c;
+        }
+        static void store4(uint32_t* p, Pixels a, Pixels b, Pixels c, Pixels d) {
+            p[0] = a;
+            p[1] = b;
+            p[2] = c;
+            p[3] = d;
+        }
+    };
+
+#if defined(__SSE2__)
+    struct VectorLanes {
+        using Pixels = __m128i;
+        static const uint COUNT = 4;
+
+        static Pixels load(const uint32_t* p) {
+            return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        }
+        static Pixels equal(Pixels a, Pixels b) {
+            return _mm_cmpeq_epi32(a, b);
+        }
+        static Pixels either(Pixels a, Pixels b) {
+            return _mm_or_si128(a, b);
+        }
+        static Pixels unless(Pixels mask, Pixels x) {
+            return _mm_andnot_si128(mask, x);
+        }
+        static Pixels select(Pixels mask, Pixels a, Pixels b) {
+            return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+        }
+        static void store(uint32_t* p, Pixels a) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(p), a);
+        }
+        static void store2(uint32_t* p, Pixels a, Pixels b) {
+            store(p, _mm_unpacklo_epi32(a, b));
+            store(p + 4, _mm_unpackhi_epi32(a, b));
+        }
+        static void store3(uint32_t* p, Pixels a, Pixels b, Pixels c) {
+            // a0 b0 c0 a1 | b1 c1 a2 b2 | c2 a3 b3 c3
+            __m128 abLow = _mm_castsi128_ps(_mm_unpacklo_epi32(a, b));
+            __m128 abHigh = _mm_castsi128_ps(_mm_unpackhi_epi32(a, b));
+            __m128 bcLow = _mm_castsi128_ps(_mm_unpacklo_epi32(b, c));
+            __m128 bcHigh = _mm_castsi128_ps(_mm_unpackhi_epi32(b, c));
+            __m128 caLow = _mm_castsi128_ps(_mm_unpacklo_epi32(c, a));
+            __m128 caHigh = _mm_castsi128_ps(_mm_unpackhi_epi32(c, a));
+            store(p, _mm_castps_si128(_mm_shuffle_ps(abLow, caLow, _MM_SHUFFLE(3, 0, 1, 0))));
+            store(p + 4, _mm_castps_si128(_mm_shuffle_ps(bcLow, abHigh, _MM_SHUFFLE(1, 0, 3, 2))));
+            store(p + 8, _mm_castps_si128(_mm_shuffle_ps(caHigh, bcHigh, _MM_SHUFFLE(3, 2, 3, 0))));
+        }
+        static void store4(uint32_t* p, Pixels a, Pixels b, Pixels c, Pixels d) {
+            // 4x4 transpose
+            Pixels abLow = _mm_unpacklo_epi32(a, b);
+            Pixels cdLow = _mm_unpacklo_epi32(c, d);
+            Pixels abHigh = _mm_unpackhi_epi32(a, b);
+            Pixels cdHigh = _mm_unpackhi_epi32(c, d);
+            store(p, _mm_unpacklo_epi64(abLow, cdLow));
+            store(p + 4, _mm_unpackhi_epi64(abLow, cdLow));
+            store(p + 8, _mm_unpacklo_epi64(abHigh, cdHigh));
+            store(p + 12, _mm_unpackhi_epi64(abHigh, cdHigh));
+        }
+    };
+#elif defined(__ARM_NEON)
+    struct VectorLanes {
+        using Pixels = uint32x4_t;
+        static const uint COUNT = 4;
+
+        static Pixels load(const uint32_t* p) {
+            return vld1q_u32(p);
+        }
+        static Pixels equal(Pixels a, Pixels b) {
+            return vceqq_u32(a, b);
+        }
+        static Pixels either(Pixels a, Pixels b) {
+            return vorrq_u32(a, b);
+        }
+        static Pixels unless(Pixels mask, Pixels x) {
+            return vbicq_u32(x, mask);
+        }
+        static Pixels select(Pixels mask, Pixels a, Pixels b) {
+            return vbslq_u32(mask, a, b);
+        }
+        static void store(uint32_t* p, Pixels a) {
+            vst1q_u32(p, a);
+        }
+        static void store2(uint32_t* p, Pixels a, Pixels b) {
+            vst2q_u32(p, uint32x4x2_t{{a, b}});
+        }
+        static void store3(uint32_t* p, Pixels a, Pixels b, Pixels c) {
+            vst3q_u32(p, uint32x4x3_t{{a, b, c}});
+        }
+        static void store4(uint32_t* p, Pixels a, Pixels b, Pixels c, Pixels d) {
+            vst4q_u32(p, uint32x4x4_t{{a, b, c, d}});
+        }
+    };
+#else
+    using VectorLanes = ScalarLanes;
+#endif
+
+    // Image with its edge pixels repeated one pixel out on every side, so the
+    // kernels can read neighbours without bounds checks
+    struct PaddedImage {
+        std::vector<uint32_t> pixels;
+        uint stride;
+
+        void fill(const uint32_t* image, uint width, uint height) {
+            stride = width + 2;
+            pixels.resize(stride * (height + 2));
+            for (uint y = 0; y < height + 2; ++y) {
+                uint sourceY = y == 0 ? 0 : (y == height + 1 ? height - 1 : y - 1);
+                const uint32_t* source = image + sourceY * width;
+                uint32_t* row = pixels.data() + y * stride;
+                row[0] = source[0];
+                memcpy(row + 1, source, width * sizeof(uint32_t));
+                row[width + 1] = source[width - 1];
+            }
+        }
+
+        // Points at pixel 0 of image row y, which may be -1 or height
+        const uint32_t* row(int y) const {
+            return pixels.data() + (y + 1) * stride + 1;
+        }
+    };
+
+    template<typename L>
+    uint nearestSpan(const uint32_t* row, uint x, uint width, uint factor, uint32_t* out) {
+        for (; x + L::COUNT <= width; x += L::COUNT) {
+            auto e = L::load(row + x);
+            uint32_t* dst = out + x * factor;
+            switch (factor) {
+                case 2: L::store2(dst, e, e); break;
+                case 3: L::store3(dst, e, e, e); break;
+                default: L::store4(dst, e, e, e, e); break;
+            }
+        }
+        return x;
+    }
+
+    void upscaleNearest(const uint32_t* image, uint width, uint height, uint factor, uint32_t* out) {
+        uint outWidth = width * factor;
+        for (uint y = 0; y < height; ++y) {
+            const uint32_t* row = image + y * width;
+            uint32_t* outRow = out + y * factor * outWidth;
+            uint x = nearestSpan<VectorLanes>(row, 0, width, factor, outRow);
+            nearestSpan<ScalarLanes>(row, x, width, factor, outRow);
+            for (uint i = 1; i < factor; ++i) {
+                memcpy(outRow + i * outWidth, outRow, outWidth * sizeof(uint32_t));
+            }
+        }
+    }
+
+    //   A B C
+    //   D E F
+    //   G H I
+    template<typename L>
+    uint scale2xSpan(const uint32_t* up, const uint32_t* row, const uint32_t* down,
+                     uint x, uint width, uint32_t* out0, uint32_t* out1) {
+        for (; x + L::COUNT <= width; x += L::COUNT) {
+            auto b = L::load(up + x);
+            auto d = L::load(row + x - 1);
+            auto e = L::load(row + x);
+            auto f = L::load(row + x + 1);
+            auto h = L::load(down + x);
+
+            // Only corners between two differing edges are rounded off
+            auto flat = L::either(L::equal(b, h), L::equal(d, f));
+            auto e0 = L::select(L::unless(flat, L::equal(d, b)), d, e);
+            auto e1 = L::select(L::unless(flat, L::equal(b, f)), f, e);
+            auto e2 = L::select(L::unless(flat, L::equal(d, h)), d, e);
+            auto e3 = L::select(L::unless(flat, L::equal(h, f)), f, e);
+
+            L::store2(out0 + 2 * x, e0, e1);
+            L::store2(out1 + 2 * x, e2, e3);
+        }
+        return x;
+    }
+
+    void upscaleScale2x(const PaddedImage& image, uint width, uint height, uint32_t* out) {
+        uint outWidth = 2 * width;
+        for (uint y = 0; y < height; ++y) {
+            const uint32_t* up = image.row(static_cast<int>(y) - 1);
+            const uint32_t* row = image.row(y);
+            const uint32_t* down = image.row(y + 1);
+            uint32_t* out0 = out + 2 * y * outWidth;
+            uint32_t* out1 = out0 + outWidth;
+            uint x = scale2xSpan<VectorLanes>(up, row, down, 0, width, out0, out1);
+            scale2xSpan<ScalarLanes>(up, row, down, x, width, out0, out1);
+        }
+    }
+
+    template<typename L>
+    uint scale3xSpan(const uint32_t* up, const uint32_t* row, const uint32_t* down,
+                     uint x, uint width, uint32_t* out0, uint32_t* out1, uint32_t* out2) {
+        for (; x + L::COUNT <= width; x += L::COUNT) {
+            auto a = L::load(up + x - 1);
+            auto b = L::load(up + x);
+            auto c = L::load(up + x + 1);
+            auto d = L::load(row + x - 1);
+            auto e = L::load(row + x);
+            auto f = L::load(row + x + 1);
+            auto g = L::load(down + x - 1);
+            auto h = L::load(down + x);
+            auto i = L::load(down + x + 1);
+
+            auto flat = L::either(L::equal(b, h), L::equal(d, f));
+            auto db = L::unless(flat, L::equal(d, b));
+            auto bf = L::unless(flat, L::equal(b, f));
+            auto dh = L::unless(flat, L::equal(d, h));
+            auto hf = L::unless(flat, L::equal(h, f));
+            auto ea = L::equal(e, a);
+            auto ec = L::equal(e, c);
+            auto eg = L::equal(e, g);
+            auto ei = L::equal(e, i);
+
+            auto e0 = L::select(db, d, e);
+            auto e1 = L::select(L::either(L::unless(ec, db), L::unless(ea, bf)), b, e);
+            auto e2 = L::select(bf, f, e);
+            auto e3 = L::select(L::either(L::unless(eg, db), L::unless(ea, dh)), d, e);
+            auto e5 = L::select(L::either(L::unless(ei, bf), L::unless(ec, hf)), f, e);
+            auto e6 = L::select(dh, d, e);
+            auto e7 = L::select(L::either(L::unless(ei, dh), L::unless(eg, hf)), h, e);
+            auto e8 = L::select(hf, f, e);
+
+            L::store3(out0 + 3 * x, e0, e1, e2);
+            L::store3(out1 + 3 * x, e3, e, e5);
+            L::store3(out2 + 3 * x, e6, e7, e8);
+        }
+        return x;
+    }
+
+    void upscaleScale3x(const PaddedImage& image, uint width, uint height, uint32_t* out) {
+        uint outWidth = 3 * width;
+        for (uint y = 0; y < height; ++y) {
+            const uint32_t* up = image.row(static_cast<int>(y) - 1);
+            const uint32_t* row = image.row(y);
+            const uint32_t* down = image.row(y + 1);
+            uint32_t* out0 = out + 3 * y * outWidth;
+            uint32_t* out1 = out0 + outWidth;
+            uint32_t* out2 = out1 + outWidth;
+            uint x = scale3xSpan<VectorLanes>(up, row, down, 0, width, out0, out1, out2);
+            scale3xSpan<ScalarLanes>(up, row, down, x, width, out0, out1, out2);
+        }
+    }
+}
+
+UpscaleConfig UpscaleConfig::parse(const std::string& name) {
+    UpscaleConfig config;
+    std::string factor = name;
+    if (name.compare(0, 5, "scale") == 0) {
+        config.filter = UPSCALE_SCALENX;
+        factor = name.substr(5);
+    }
+    if (factor.size() != 2 || factor[1] != 'x' || factor[0] < '1' || factor[0] > '4') {
+        throw std::runtime_error("unknown upscale mode " + name);
+    }
+    config.factor = factor[0] - '0';
+    return config;
+}
+
+void FrameUpscaler::upscale(const UpscaleConfig& config,
+                            const uint8_t* rgba,
+                            uint width,
+                            uint height,
+                            uint8_t* out) {
+    if (config.factor < 1 || config.factor > 4) {
+        throw std::runtime_error("upscale factor must be between 1 and 4");
+    }
+    if (config.factor == 1) {
+        memcpy(out, rgba, width * height * sizeof(uint32_t));
+        return;
+    }
+
+    // Pixels are only ever compared & copied whole
+    const uint32_t* image = reinterpret_cast<const uint32_t*>(rgba);
+    uint32_t* outImage = reinterpret_cast<uint32_t*>(out);
+    if (config.filter == UPSCALE_NEAREST) {
+        upscaleNearest(image, width, height, config.factor, outImage);
+        return;
+    }
+
+    // Reused between frames, exporters upscale on each of their workers
+    thread_local PaddedImage padded;
+    thread_local std::vector<uint32_t> doubled;
+    padded.fill(image, width, height);
+    switch (config.factor) {
+        case 2:
+            upscaleScale2x(padded, width, height, outImage);
+            break;
+        case 3:
+            upscaleScale3x(padded, width, height, outImage);
+            break;
+        case 4:
+            doubled.resize(4 * width * height);
+            upscaleScale2x(padded, width, height, doubled.data());
+            padded.fill(doubled.data(), 2 * width, 2 * height);
+            upscaleScale2x(padded, 2 * width, 2 * height, outImage);
+            break;
+    }
+}
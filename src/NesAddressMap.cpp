@@ -0,0 +1,146 @@
+#include "NesAddressMap.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+    const VkDeviceSize NAMETABLES_START = offsetof(nes::PPUMemory, nameTables);
+    const VkDeviceSize NAMETABLES_END = offsetof(nes::PPUMemory, padding0);
+    const VkDeviceSize PALETTES_START = offsetof(nes::PPUMemory, backgroundPalettes);
+    const VkDeviceSize PALETTES_END = offsetof(nes::PPUMemory, padding1);
+    const VkDeviceSize NAMETABLE_SIZE = sizeof(nes::NameTable);
+
+    struct Span {
+        VkDeviceSize from;
+        VkDeviceSize to;
+    };
+}
+
+NesAddressMap::NesAddressMap(nes::Mirroring mirroring)
+: mirroring_(mirroring) {
+    switch (mirroring) {
+        case nes::HORIZONTAL_MIRRORING: nametableMap_ = {0, 0, 1, 1}; break;
+        case nes::VERTICAL_MIRRORING: nametableMap_ = {0, 1, 0, 1}; break;
+        case nes::SINGLE_SCREEN_MIRRORING: nametableMap_ = {0, 0, 0, 0}; break;
+        default: throw std::runtime_error("packed PPU memory only backs two nametables");
+    }
+}
+
+bool NesAddressMap::matches(const nes::PPUMemory& ppu) const {
+    for (uint a = 0; a < 4; ++a) {
+        for (uint b = a + 1; b < 4; ++b) {
+            if (nametableMap_[a] == nametableMap_[b]
+                && memcmp(&ppu.nameTables[a], &ppu.nameTables[b], sizeof(nes::NameTable)) != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+nes::PackedPPUMemory NesAddressMap::pack(const nes::PPUMemory& ppu) const {
+    nes::PackedPPUMemory packed{};
+    memcpy(packed.tileSets, ppu.tileSets, sizeof(packed.tileSets));
+    memcpy(packed.backgroundPalettes, ppu.backgroundPalettes, sizeof(packed.backgroundPalettes));
+    memcpy(packed.spritePalettes, ppu.spritePalettes, sizeof(packed.spritePalettes));
+    memcpy(packed.nametableMap, nametableMap_.data(), sizeof(packed.nametableMap));
+    // Like translate, later nametables win
+    for (uint nametable = 0; nametable < 4; ++nametable) {
+        packed.nameTables[nametableMap_[nametable]] = ppu.nameTables[nametable];
+    }
+    return packed;
+}
+
+template<typename Visit>
+void NesAddressMap::forEachNametablePiece(const VkBufferCopy& region, Visit visit) const {
+    VkDeviceSize start = region.dstOffset;
+    VkDeviceSize end = region.dstOffset + region.size;
+
+    // Offsets already claimed by a later nametable, per physical nametable
+    std::array<std::vector<Span>, 2> claimed;
+    for (int nametable = 3; nametable >= 0; --nametable) {
+        VkDeviceSize tableStart = NAMETABLES_START + nametable * NAMETABLE_SIZE;
+        VkDeviceSize from = std::max(start, tableStart);
+        VkDeviceSize to = std::min(end, tableStart + NAMETABLE_SIZE);
+        if (from >= to) {
+            continue;
+        }
+
+        Span written{from - tableStart, to - tableStart};
+        std::vector<Span> pieces{written};
+        auto& physicalClaims = claimed[nametableMap_[nametable]];
+        for (const auto& claim : physicalClaims) {
+            std::vector<Span> remaining;
+            for (const auto& piece : pieces) {
+                if (piece.from < claim.from) {
+                    remaining.push_back(Span{piece.from, std::min(piece.to, claim.from)});
+                }
+                if (piece.to > claim.to) {
+                    remaining.push_back(Span{std::max(piece.from, claim.to), piece.to});
+                }
+            }
+            pieces = remaining;
+        }
+        physicalClaims.push_back(written);
+
+        for (const auto& piece : pieces) {
+            visit(static_cast<uint>(nametable), piece.from, piece.to);
+        }
+    }
+}
+
+void NesAddressMap::translate(const VkBufferCopy& region, std::vector<VkBufferCopy>& packed) const {
+    VkDeviceSize start = region.dstOffset;
+    VkDeviceSize end = region.dstOffset + region.size;
+    auto emit = [&](VkDeviceSize from, VkDeviceSize to, VkDeviceSize packedOffset) {
+        if (from < to) {
+            packed.push_back(VkBufferCopy{region.srcOffset + (from - start), packedOffset, to - from});
+        }
+    };
+
+    // Pattern tables sit at the same offset in both layouts
+    emit(start, std::min(end, NAMETABLES_START), start);
+
+    forEachNametablePiece(region, [&](uint nametable, VkDeviceSize from, VkDeviceSize to) {
+        VkDeviceSize tableStart = NAMETABLES_START + nametable * NAMETABLE_SIZE;
+        emit(tableStart + from,
+             tableStart + to,
+             offsetof(nes::PackedPPUMemory, nameTables) + nametableMap_[nametable] * NAMETABLE_SIZE + from);
+    });
+
+    VkDeviceSize paletteFrom = std::max(start, PALETTES_START);
+    emit(paletteFrom,
+         std::min(end, PALETTES_END),
+         offsetof(nes::PackedPPUMemory, backgroundPalettes) + (paletteFrom - PALETTES_START));
+}
+
+void NesAddressMap::expandMirrors(const VkBufferCopy& region, std::vector<VkBufferCopy>& mirrored) const {
+    VkDeviceSize start = region.dstOffset;
+    VkDeviceSize end = region.dstOffset + region.size;
+    auto emit = [&](VkDeviceSize from, VkDeviceSize to, VkDeviceSize dstOffset) {
+        if (from < to) {
+            mirrored.push_back(VkBufferCopy{region.srcOffset + (from - start), dstOffset, to - from});
+        }
+    };
+
+    // Everything outside the nametables is copied as is
+    emit(start, std::min(end, NAMETABLES_START), start);
+    VkDeviceSize afterFrom = std::max(start, NAMETABLES_END);
+    emit(afterFrom, end, afterFrom);
+
+    // What lands in each physical nametable is repeated into all of its mirrors
+    forEachNametablePiece(region, [&](uint nametable, VkDeviceSize from, VkDeviceSize to) {
+        VkDeviceSize srcStart = NAMETABLES_START + nametable * NAMETABLE_SIZE;
+        for (uint mirror = 0; mirror < 4; ++mirror) {
+            if (nametableMap_[mirror] != nametableMap_[nametable]) {
+                continue;
+            }
+            VkDeviceSize mirrorStart = NAMETABLES_START + mirror * NAMETABLE_SIZE;
+            mirrored.push_back(VkBufferCopy{region.srcOffset + (srcStart + from - start),
+                                            mirrorStart + from,
+                                            to - from});
+        }
+    });
+}
@@ -0,0 +1,154 @@
+#include "NesBackgroundCache.h"
+
+#include "UboUtil.h"
+
+#include <VulkanApp.h>
+
+namespace {
+    const uint CELLS_PER_TILESET = 4 * 960;
+
+    uint cellAttributeIndex(uint cell) {
+        uint tileLocation = cell % 960;
+        return (tileLocation / 32 / 4) * 8 + (tileLocation % 32) / 4;
+    }
+}
+
+NesBackgroundCache::NesBackgroundCache(VulkanApp<F>& app,
+                                       VkBuffer ppuBuffer,
+                                       bool compactMemory,
+                                       const NesFrameTracker& frameTracker,
+                                       const std::vector<char>& rasterShaderCode)
+: frameTracker_(frameTracker) {
+    cacheImage_ = std::make_unique<ComputeImage>(app.getDevice(),
+                                                 app.getPhysicalDevice(),
+                                                 app.getGraphicsQueue(),
+                                                 app.getCommandPool(),
+                                                 CACHE_WIDTH,
+                                                 CACHE_HEIGHT,
+                                                 VK_FORMAT_R8_UINT);
+
+    // Filled with vkCmdUpdateBuffer right before each rasterization
+    Buffer<BackgroundCacheCells>::create(cellBuffer_,
+                                         1,
+                                         VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                         app.getDevice(),
+                                         app.getPhysicalDevice());
+
+    rasterMaterial_ = std::make_unique<RasterMat>(app.getDevice(),
+                                                  app.getPhysicalDevice(),
+                                                  std::vector<std::shared_ptr<Descriptor>>{
+                                                  createPpuMemoryDescriptor(ppuBuffer, compactMemory),
+                                                  std::make_shared<UniformBufferDescriptor<BackgroundCacheCells, F>>(
+                                                      std::array<VkBuffer, F>{cellBuffer_->getBuffer()},
+                                                      VK_SHADER_STAGE_COMPUTE_BIT),
+                                                  std::make_shared<StorageImageDescriptor<F>>(
+                                                      VK_SHADER_STAGE_COMPUTE_BIT,
+                                                      std::array<VkImageView, F>{cacheImage_->getImageView()})
+                                                  },
+                                                  rasterShaderCode);
+}
+
+NesBackgroundCache::~NesBackgroundCache() = default;
+
+void NesBackgroundCache::recordBeforeDispatch(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint firstScanline) {
+    const auto& ppu = frameTracker_.getStateAt(firstScanline).ppu;
+    collectDirtyCells(ppu);
+    if (pendingCells_.count == 0) {
+        return;
+    }
+
+    // The previous rasterization & main pass may still be reading the cell list & cache
+    VkMemoryBarrier readBarrier{};
+    readBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 1, &readBarrier, 0, nullptr, 0, nullptr);
+
+    // Upload only as much of the cell list as is in use, rounded up to 4 bytes
+    size_t uploadSize = offsetof(BackgroundCacheCells, cells) + pendingCells_.count * sizeof(uint16_t);
+    uploadSize = (uploadSize + 3) & ~size_t(3);
+    vkCmdUpdateBuffer(commandBuffer, cellBuffer_->getBuffer(), 0, uploadSize, &pendingCells_);
+
+    VkMemoryBarrier uploadBarrier{};
+    uploadBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    uploadBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    uploadBarrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 1, &uploadBarrier, 0, nullptr, 0, nullptr);
+
+    // One workgroup per dirty cell
+    rasterMaterial_->setCellCount(pendingCells_.count);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, rasterMaterial_->getPipeline());
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            rasterMaterial_->getPipelineLayout(),
+                            0, 1,
+                            rasterMaterial_->getDescriptorSet(frameIndex),
+                            0, 0);
+    auto dispatchSize = rasterMaterial_->getDispatchDimensions();
+    vkCmdDispatch(commandBuffer, dispatchSize.x, dispatchSize.y, dispatchSize.z);
+
+    // The main pass samples what was just rasterized
+    VkMemoryBarrier cacheBarrier{};
+    cacheBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    cacheBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    cacheBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 1, &cacheBarrier, 0, nullptr, 0, nullptr);
+
+    *rasterized_ = ppu;
+}
+
+void NesBackgroundCache::collectDirtyCells(const nes::PPUMemory& ppu) {
+    pendingCells_.count = 0;
+
+    // Rasterize everything the first time around
+    if (rasterized_ == nullptr) {
+        rasterized_ = std::make_unique<nes::PPUMemory>();
+        for (uint cell = 0; cell < BackgroundCacheCells::MAX_CELLS; ++cell) {
+            pendingCells_.cells[pendingCells_.count++] = cell;
+        }
+        return;
+    }
+
+    // Palettes aren't baked into the cache, so only tiles & nametables matter
+    if (memcmp(rasterized_.get(), &ppu, offsetof(nes::PPUMemory, padding0)) == 0) {
+        return;
+    }
+
+    std::bitset<2 * 256> dirtyTiles;
+    for (uint tileset = 0; tileset < 2; ++tileset) {
+        for (uint tile = 0; tile < 256; ++tile) {
+            if (memcmp(&rasterized_->tileSets[tileset].tiles[tile],
+                       &ppu.tileSets[tileset].tiles[tile],
+                       sizeof(nes::Tile)) != 0) {
+                dirtyTiles.set(tileset * 256 + tile);
+            }
+        }
+    }
+
+    std::bitset<CELLS_PER_TILESET> dirtyCells;
+    for (uint cell = 0; cell < CELLS_PER_TILESET; ++cell) {
+        const auto& before = rasterized_->nameTables[cell / 960];
+        const auto& after = ppu.nameTables[cell / 960];
+        uint attributeIdx = cellAttributeIndex(cell);
+        if (before.tileIndies[cell % 960] != after.tileIndies[cell % 960]
+            || before.attributeTable[attributeIdx] != after.attributeTable[attributeIdx]) {
+            dirtyCells.set(cell);
+        }
+    }
+
+    for (uint tileset = 0; tileset < 2; ++tileset) {
+        for (uint cell = 0; cell < CELLS_PER_TILESET; ++cell) {
+            uint tileIdx = ppu.nameTables[cell / 960].tileIndies[cell % 960];
+            if (dirtyCells.test(cell) || dirtyTiles.test(tileset * 256 + tileIdx)) {
+                pendingCells_.cells[pendingCells_.count++] = tileset * CELLS_PER_TILESET + cell;
+            }
+        }
+    }
+}
@@ -0,0 +1,170 @@
+#include "NesFeedUpdator.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+std::unique_ptr<NesFeedUpdator> NesFeedUpdator::attach(MemoryUpdateComposer& composer,
+                                                       const std::string& feedName,
+                                                       const nes::PPUMemory& ppu,
+                                                       const nes::OAM& oam,
+                                                       const nes::Control& control) {
+    auto ring = ShmFeedRing::attach(feedName);
+
+    // Added back to back so a single span covers all three. They have no updates
+    // of their own, the changed ranges are handed over each frame instead
+    auto ppuRegion = composer.addStagingField(BufferIndex::PPU, 0, sizeof(nes::PPUMemory), (void*) &ppu);
+    auto oamRegion = composer.addStagingField(BufferIndex::OAM, 0, sizeof(nes::OAM), (void*) &oam);
+    auto controlRegion = composer.addStagingField(BufferIndex::CONTROL, 0, sizeof(nes::Control), (void*) &control);
+
+    StagingRegionHandle span = ppuRegion;
+    span.size = controlRegion.stagingDataOffset + controlRegion.size - ppuRegion.stagingDataOffset;
+
+    std::unique_ptr<NesFeedUpdator> updator(new NesFeedUpdator(span,
+                                                               std::move(ring),
+                                                               {composer.getBufferHandle(BufferIndex::PPU),
+                                                                composer.getBufferHandle(BufferIndex::OAM),
+                                                                composer.getBufferHandle(BufferIndex::CONTROL)}));
+    updator->regionOffsets_ = {0,
+                               oamRegion.stagingDataOffset - span.stagingDataOffset,
+                               controlRegion.stagingDataOffset - span.stagingDataOffset};
+    updator->regionSizes_ = {ppuRegion.size, oamRegion.size, controlRegion.size};
+
+    // The updator is owned by the clock, which outlives the compute node's use of it
+    NesFeedUpdator* source = updator.get();
+    composer.setScanlineWriteSource([source]() -> const std::vector<ScanlineWrite>& {
+        return source->getScanlineWrites();
+    });
+    composer.setFrameUpdateSource([source]() -> const std::vector<MemoryUpdate>& {
+        return source->getUpdates();
+    });
+    return updator;
+}
+
+NesFeedUpdator::NesFeedUpdator(StagingRegionHandle span,
+                               std::unique_ptr<ShmFeedRing>&& ring,
+                               std::array<VkBuffer, 3> buffers)
+: GameClock::UpdateFunction(span),
+  ring_(std::move(ring)),
+  buffers_(buffers) {}
+
+void NesFeedUpdator::execute(void* mappedData) {
+    uint8_t* stagingData = static_cast<uint8_t*>(mappedData);
+
+    // The first frame copies the regions as they were initialized
+    if (!keyframeCopied_) {
+        for (uint8_t buffer = FEED_PPU; buffer <= FEED_CONTROL; ++buffer) {
+            markChanged(static_cast<FeedBuffer>(buffer), 0, regionSizes_[buffer]);
+        }
+        keyframeCopied_ = true;
+    }
+
+    bool received = false;
+    while (const uint8_t* slot = ring_->beginRead()) {
+        FeedFrameReader reader(slot, ring_->getSlotSize());
+        // Scanline writes only last for the frame they were sent with
+        registerWrites_.clear();
+
+        FeedRecord record;
+        const uint8_t* data;
+        while (reader.next(record, data)) {
+            if (record.buffer > FEED_CONTROL
+                || record.size > regionSizes_[record.buffer]
+                || record.offset > regionSizes_[record.buffer] - record.size) {
+                throw std::runtime_error("feed record is outside of its buffer");
+            }
+
+            if (record.kind == FEED_DELTA) {
+                memcpy(stagingData + regionOffsets_[record.buffer] + record.offset, data, record.size);
+                markChanged(record.buffer, record.offset, record.size);
+            } else if (record.kind == FEED_SCANLINE_WRITE) {
+                if (record.buffer != FEED_CONTROL || record.scanline >= SCANLINES) {
+                    throw std::runtime_error("feed scanline write must target Control on a visible scanline");
+                }
+                RegisterWrite write{record.scanline,
+                                    static_cast<uint8_t>(record.offset),
+                                    static_cast<uint8_t>(record.size),
+                                    {}};
+                memcpy(write.bytes, data, record.size);
+                registerWrites_.push_back(write);
+            } else {
+                throw std::runtime_error("unknown feed record");
+            }
+        }
+
+        lastFeedFrame_ = reader.getFrame();
+        ring_->endRead();
+        received = true;
+    }
+
+    buildUpdates();
+    if (received) {
+        buildScanlineWrites(stagingData);
+    }
+}
+
+void NesFeedUpdator::markChanged(FeedBuffer buffer, size_t offset, size_t size) {
+    if (size > 0) {
+        VkDeviceSize srcOffset = handle_.stagingDataOffset + regionOffsets_[buffer] + offset;
+        changed_[buffer].push_back(VkBufferCopy{srcOffset, offset, size});
+    }
+}
+
+void NesFeedUpdator::buildUpdates() {
+    updates_.clear();
+    for (size_t buffer = 0; buffer < changed_.size(); ++buffer) {
+        auto& ranges = changed_[buffer];
+        if (ranges.empty()) {
+            continue;
+        }
+        std::sort(ranges.begin(), ranges.end(), [](const VkBufferCopy& a, const VkBufferCopy& b) {
+            return a.dstOffset < b.dstOffset;
+        });
+
+        // Source & destination move together, so touching ranges merge into one copy
+        MemoryUpdate update{buffers_[buffer], {ranges.front()}};
+        for (size_t i = 1; i < ranges.size(); ++i) {
+            auto& last = update.regions.back();
+            if (ranges[i].dstOffset <= last.dstOffset + last.size) {
+                last.size = std::max(last.size, ranges[i].dstOffset + ranges[i].size - last.dstOffset);
+            } else {
+                update.regions.push_back(ranges[i]);
+            }
+        }
+        updates_.push_back(std::move(update));
+        ranges.clear();
+    }
+}
+
+void NesFeedUpdator::buildScanlineWrites(const uint8_t* stagingData) {
+    std::stable_sort(registerWrites_.begin(), registerWrites_.end(), [](const RegisterWrite& a, const RegisterWrite& b) {
+        return a.scanline < b.scanline;
+    });
+
+    // vkCmdUpdateBuffer needs 4 byte granularity, so the whole struct is written each time
+    nes::Control control;
+    memcpy(&control, stagingData + regionOffsets_[FEED_CONTROL], sizeof(nes::Control));
+
+    scanlineControls_.clear();
+    scanlineControls_.reserve(registerWrites_.size());
+    std::vector<uint> scanlines;
+    for (size_t i = 0; i < registerWrites_.size(); ++i) {
+        const auto& write = registerWrites_[i];
+        memcpy(reinterpret_cast<uint8_t*>(&control) + write.offset, write.bytes, write.size);
+        bool lastAtScanline = i + 1 == registerWrites_.size() || registerWrites_[i + 1].scanline != write.scanline;
+        if (lastAtScanline) {
+            scanlineControls_.push_back(control);
+            scanlines.push_back(write.scanline);
+        }
+    }
+
+    // Pointers are taken once scanlineControls_ has stopped growing
+    scanlineWrites_.clear();
+    for (size_t i = 0; i < scanlineControls_.size(); ++i) {
+        scanlineWrites_.push_back(ScanlineWrite{scanlines[i],
+                                                buffers_[FEED_CONTROL],
+                                                0,
+                                                sizeof(nes::Control),
+                                                &scanlineControls_[i]});
+    }
+}
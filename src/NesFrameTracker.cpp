@@ -0,0 +1,216 @@
+#include "NesFrameTracker.h"
+
+#include <algorithm>
+
+namespace {
+    const size_t NAMETABLE_BASE = offsetof(nes::PPUMemory, nameTables);
+    const size_t NAMETABLE_END = offsetof(nes::PPUMemory, padding0);
+    const size_t PALETTE_BASE = offsetof(nes::PPUMemory, backgroundPalettes);
+    const size_t PALETTE_END = offsetof(nes::PPUMemory, padding1);
+    const uint NAMETABLE_ROWS = 30;
+    const uint NAMETABLE_COLUMNS = 32;
+
+    // Which of the four background palettes a nametable cell uses
+    // https://www.nesdev.org/wiki/PPU_attribute_tables
+    uint cellPalette(const nes::NameTable& nameTable, uint row, uint column) {
+        uint8_t attributeByte = nameTable.attributeTable[(row / 4) * 8 + column / 4];
+        uint indexInAttributeByte = ((row / 2) % 2) * 2 + (column / 2) % 2;
+        return (attributeByte >> (2 * indexInAttributeByte)) & 0x3;
+    }
+}
+
+NesFrameTracker::NesFrameTracker(const nes::PPUMemory& ppu,
+                                 const nes::OAM& oam,
+                                 const nes::Control& control,
+                                 UpdateSchedule schedule)
+: schedule_(std::move(schedule)) {
+    NesMemoryState initialState;
+    initialState.ppu = ppu;
+    initialState.oam = oam;
+    initialState.control = control;
+
+    // Split the frame into segments at every scanline with updates
+    if (schedule_.empty() || schedule_.begin()->first != 0) {
+        segments_.push_back(Segment{0, SCANLINES, nullptr, initialState});
+    }
+    for (const auto& [scanline, copies] : schedule_) {
+        if (scanline >= SCANLINES) {
+            break;
+        }
+        if (!segments_.empty()) {
+            segments_.back().endScanline = scanline;
+        }
+        segments_.push_back(Segment{scanline, SCANLINES, &copies, initialState});
+    }
+
+    // Only bytes that some copy writes to can ever change
+    for (const auto& [scanline, copies] : schedule_) {
+        for (const auto& copy : copies) {
+            watchedRanges_.push_back(WatchedRange{copy.bufferIndex,
+                                                  copy.region.dstOffset,
+                                                  copy.region.dstOffset + copy.region.size});
+        }
+    }
+    std::sort(watchedRanges_.begin(), watchedRanges_.end(), [](const WatchedRange& a, const WatchedRange& b) {
+        return a.bufferIndex != b.bufferIndex ? a.bufferIndex < b.bufferIndex : a.begin < b.begin;
+    });
+    std::vector<WatchedRange> merged;
+    for (const auto& range : watchedRanges_) {
+        if (!merged.empty() && merged.back().bufferIndex == range.bufferIndex && range.begin <= merged.back().end) {
+            merged.back().end = std::max(merged.back().end, range.end);
+        } else {
+            merged.push_back(range);
+        }
+    }
+    watchedRanges_ = std::move(merged);
+}
+
+void NesFrameTracker::beginFrame(const uint8_t* stagingData) {
+    dirtyScanlines_.reset();
+
+    // Memory carries over from the end of the previous frame
+    NesMemoryState state = segments_.back().state;
+    for (auto& segment : segments_) {
+        if (segment.copies != nullptr) {
+            for (const auto& copy : *segment.copies) {
+                state.apply(copy, stagingData);
+            }
+        }
+
+        if (!firstFrame_) {
+            markSegment(segment.state, state, segment.firstScanline, segment.endScanline);
+        }
+        segment.state = state;
+    }
+
+    if (firstFrame_) {
+        dirtyScanlines_.set();
+        firstFrame_ = false;
+    }
+}
+
+const NesMemoryState& NesFrameTracker::getStateAt(uint scanline) const {
+    auto segment = std::upper_bound(segments_.begin(), segments_.end(), scanline, [](uint line, const Segment& s) {
+        return line < s.firstScanline;
+    });
+    return std::prev(segment)->state;
+}
+
+void NesFrameTracker::markSegment(const NesMemoryState& previous,
+                                  const NesMemoryState& current,
+                                  uint first,
+                                  uint end) {
+    std::bitset<2 * 256> dirtyTiles;
+    // Nametable rows whose tile indices or attributes changed
+    std::bitset<4 * NAMETABLE_ROWS> dirtyRows;
+    // Bits 0-3 are background palettes, 4-7 sprite palettes
+    uint dirtyPalettes = 0;
+    std::bitset<64> dirtySprites;
+    bool wholeSegment = false;
+
+    for (const auto& range : watchedRanges_) {
+        const uint8_t* before = previous.bytes(range.bufferIndex);
+        const uint8_t* after = current.bytes(range.bufferIndex);
+        for (size_t address = range.begin; address < range.end; ++address) {
+            if (before[address] == after[address]) {
+                continue;
+            }
+
+            if (range.bufferIndex == BufferIndex::CONTROL) {
+                // Control affects every pixel of every scanline it applies to
+                wholeSegment = true;
+            } else if (range.bufferIndex == BufferIndex::OAM) {
+                dirtySprites.set(address / sizeof(nes::Sprite));
+            } else if (address < NAMETABLE_BASE) {
+                dirtyTiles.set(address / sizeof(nes::Tile));
+            } else if (address < NAMETABLE_END) {
+                size_t nameTableIdx = (address - NAMETABLE_BASE) / sizeof(nes::NameTable);
+                size_t offset = (address - NAMETABLE_BASE) % sizeof(nes::NameTable);
+                if (offset < sizeof(nes::NameTable::tileIndies)) {
+                    dirtyRows.set(nameTableIdx * NAMETABLE_ROWS + offset / NAMETABLE_COLUMNS);
+                } else {
+                    // Each attribute byte covers 4 rows of tiles
+                    uint attributeRow = (offset - sizeof(nes::NameTable::tileIndies)) / 8;
+                    for (uint row = attributeRow * 4; row < std::min(attributeRow * 4 + 4, NAMETABLE_ROWS); ++row) {
+                        dirtyRows.set(nameTableIdx * NAMETABLE_ROWS + row);
+                    }
+                }
+            } else if (address >= PALETTE_BASE && address < PALETTE_END) {
+                uint paletteIdx = (address - PALETTE_BASE) / sizeof(nes::Palette);
+                uint colorIdx = (address - PALETTE_BASE) % sizeof(nes::Palette);
+                if (paletteIdx == 4 && colorIdx == 0) {
+                    // The first sprite palette's first color is drawn wherever nothing else is
+                    wholeSegment = true;
+                } else if (colorIdx != 0) {
+                    // Other first colors are never drawn
+                    dirtyPalettes |= 1u << paletteIdx;
+                }
+            }
+        }
+    }
+
+    if (wholeSegment) {
+        for (uint y = first; y < end; ++y) {
+            dirtyScanlines_.set(y);
+        }
+        return;
+    }
+
+    // Background
+    const auto& control = current.control;
+    bool checkCells = dirtyTiles.any() || (dirtyPalettes & 0x0F) != 0;
+    if (dirtyRows.any() || checkCells) {
+        uint backgroundTileset = control.backgroundTileset & 0x1;
+        for (uint y = first; y < end; ++y) {
+            // Same nametable selection as the shader
+            uint nameTableIdxY = ((y + control.yScroll) % 480) / 240;
+            uint firstNameTableIdxX = (control.xScroll % 512) / 256;
+            uint nameTableCount = (control.xScroll % 256 == 0) ? 1 : 2;
+            uint row = (y % 240) / 8;
+
+            for (uint i = 0; i < nameTableCount && !dirtyScanlines_.test(y); ++i) {
+                uint nameTableIdxX = (firstNameTableIdxX + i) % 2;
+                uint nameTableIdx = (control.nametableStart + nameTableIdxY * 2 + nameTableIdxX) % 4;
+                if (dirtyRows.test(nameTableIdx * NAMETABLE_ROWS + row)) {
+                    dirtyScanlines_.set(y);
+                    break;
+                }
+                if (!checkCells) {
+                    continue;
+                }
+
+                const auto& nameTable = current.ppu.nameTables[nameTableIdx];
+                for (uint column = 0; column < NAMETABLE_COLUMNS; ++column) {
+                    uint tileIdx = nameTable.tileIndies[row * NAMETABLE_COLUMNS + column];
+                    if (dirtyTiles.test(backgroundTileset * 256 + tileIdx)
+                        || (dirtyPalettes & (1u << cellPalette(nameTable, row, column))) != 0) {
+                        dirtyScanlines_.set(y);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    // Sprites
+    uint height = spriteHeight(control);
+    bool sprites8x16 = control.spriteHeight == 1;
+    for (uint i = 0; i < 64; ++i) {
+        const auto& sprite = current.oam.sprites[i];
+        bool dirty = dirtySprites.test(i);
+        if (dirty) {
+            // Clear out wherever the sprite used to be
+            markSprite(previous.oam.sprites[i], height, first, end);
+        }
+
+        uint tileset = sprites8x16 ? (sprite.tileIndex & 0x1) : (control.spriteTileset & 0x1);
+        uint tileIdx = sprite.tileIndex & (sprites8x16 ? 0xFE : 0xFF);
+        dirty = dirty
+            || dirtyTiles.test(tileset * 256 + tileIdx)
+            || (tileIdx < 255 && dirtyTiles.test(tileset * 256 + tileIdx + 1))
+            || (dirtyPalettes & (1u << (4 + (sprite.attr & nes::SpriteAttrMask::TILE_HIGH_BITS)))) != 0;
+        if (dirty) {
+            markSprite(sprite, height, first, end);
+        }
+    }
+}
@@ -0,0 +1,144 @@
+#include "NesSoftwareRenderer.h"
+
+#include <array>
+
+namespace {
+    // Same table as nes.comp
+    const uint8_t COLORS[64][3] = {
+        {124, 124, 124}, {0, 0, 252}, {0, 0, 188}, {68, 40, 188},
+        {148, 0, 132}, {168, 0, 32}, {168, 16, 0}, {136, 20, 0},
+        {80, 48, 0}, {0, 120, 0}, {0, 104, 0}, {0, 88, 0},
+        {0, 64, 88}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0},
+        {188, 188, 188}, {0, 120, 248}, {0, 88, 248}, {104, 68, 252},
+        {216, 0, 204}, {228, 0, 88}, {248, 56, 0}, {228, 92, 16},
+        {172, 124, 0}, {0, 184, 0}, {0, 168, 0}, {0, 168, 68},
+        {0, 136, 136}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0},
+        {248, 248, 248}, {60, 188, 252}, {104, 136, 252}, {152, 120, 248},
+        {248, 120, 248}, {248, 88, 152}, {248, 120, 88}, {252, 160, 68},
+        {248, 184, 0}, {184, 248, 24}, {88, 216, 84}, {88, 248, 152},
+        {0, 232, 216}, {120, 120, 120}, {0, 0, 0}, {0, 0, 0},
+        {252, 252, 252}, {164, 228, 252}, {184, 184, 248}, {216, 184, 248},
+        {248, 184, 248}, {248, 164, 192}, {240, 208, 176}, {252, 224, 168},
+        {248, 216, 120}, {216, 248, 120}, {184, 248, 184}, {184, 248, 216},
+        {0, 252, 252}, {248, 216, 248}, {0, 0, 0}, {0, 0, 0},
+    };
+
+    uint unpack2BitsFromByte(uint8_t packed, uint byteIdx) {
+        return (packed >> (2 * byteIdx)) & 0x3;
+    }
+
+    uint unpackBitFromByte(uint8_t packed, uint byteIdx) {
+        return (packed >> (7 - byteIdx)) & 0x1;
+    }
+
+    uint sampleTile(const nes::Tile& tile, uint x, uint y) {
+        uint lowBit = unpackBitFromByte(tile.plane0[y % 8], x % 8);
+        uint highBit = unpackBitFromByte(tile.plane1[y % 8], x % 8);
+        return (highBit << 1) | lowBit;
+    }
+
+    bool spriteOnScanline(const nes::Sprite& sprite, uint y, uint height) {
+        return y >= sprite.y && y < sprite.y + height;
+    }
+
+    bool spriteOnColumn(const nes::Sprite& sprite, uint x) {
+        return x >= sprite.x && x < sprite.x + 8u;
+    }
+}
+
+void NesSoftwareRenderer::renderScanline(const NesMemoryState& state, uint y, uint8_t* rgbaRow) {
+    const auto& memory = state.ppu;
+    const auto& control = state.control;
+    bool sprites8x16 = control.spriteHeight == 1;
+    uint spriteHeight = sprites8x16 ? 16 : 8;
+
+    // Same reduction as reduceScanlineSprites, which keeps the last on-line
+    // sprite of each index modulo 8 rather than the first 8 on the line
+    std::array<nes::Sprite, 64> scanlineSprites;
+    std::array<uint, 64> workIndices;
+    for (uint i = 0; i < 64; ++i) {
+        scanlineSprites[i] = state.oam.sprites[i];
+        // Sprite evaluation is delayed by a scanline, wrapping as the shader's uint8_t does
+        scanlineSprites[i].y += 1;
+        workIndices[i] = i;
+    }
+    for (uint stride : {32u, 16u, 8u}) {
+        for (uint i = 0; i < stride; ++i) {
+            const auto& s1 = scanlineSprites[i];
+            const auto& s2 = scanlineSprites[i + stride];
+            bool useIndexCheck = spriteOnScanline(s1, y, spriteHeight) == spriteOnScanline(s2, y, spriteHeight);
+            bool select = useIndexCheck
+                ? workIndices[i] > workIndices[i + stride]
+                : spriteOnScanline(s1, y, spriteHeight);
+            if (!select) {
+                scanlineSprites[i] = s2;
+                workIndices[i] = workIndices[i + stride];
+            }
+        }
+    }
+
+    // Out of range tileset & color indices are undefined on the GPU, wrap them here
+    const auto& backgroundTiles = memory.tileSets[control.backgroundTileset & 1];
+    const auto& spriteTiles = memory.tileSets[control.spriteTileset & 1];
+
+    for (uint x = 0; x < WIDTH; ++x) {
+        // Nametable is chosen at the scrolled position, but sampled at the unscrolled one like the shader
+        uint nameTableIdxY = ((y + control.yScroll) % 480) / 240;
+        uint nameTableIdxX = ((x + control.xScroll) % 512) / 256;
+        uint nameTableIdx = (control.nametableStart + (nameTableIdxY * 2) + nameTableIdxX) % 4;
+        const auto& nameTable = memory.nameTables[nameTableIdx];
+
+        uint tileX = x / 8;
+        uint tileY = y / 8;
+        uint tileIdx = nameTable.tileIndies[tileY * 32 + tileX];
+        uint8_t attributeByte = nameTable.attributeTable[(tileY / 4) * 8 + (tileX / 4)];
+        uint palletteIdx = unpack2BitsFromByte(attributeByte, ((y / 16) % 2) * 2 + (x / 16) % 2);
+        const nes::Palette* pallete = &memory.backgroundPalettes[palletteIdx];
+        uint indexIntoPalette = sampleTile(backgroundTiles.tiles[tileIdx], x, y);
+
+        // Loop through indices backwards for correct overlap
+        bool spritePriority = false;
+        uint spriteIndexIntoPalette = 0;
+        uint spritePaletteIndex = 0;
+        for (int spriteIdx = 7; spriteIdx >= 0; --spriteIdx) {
+            const auto& sprite = scanlineSprites[spriteIdx];
+            if (!spriteOnScanline(sprite, y, spriteHeight) || !spriteOnColumn(sprite, x)) {
+                continue;
+            }
+            uint yFlip = (sprite.attr & nes::VERTICAL_FLIP) >> 7;
+            const auto& tileSet = sprites8x16 ? memory.tileSets[sprite.tileIndex & 0x1] : spriteTiles;
+            uint spriteTileIdx = (sprite.tileIndex & (sprites8x16 ? 0xFE : 0xFF))
+                + ((y - sprite.y > 7) ? 1 - yFlip : yFlip);
+            uint xIntoTile = x - sprite.x;
+            xIntoTile = (sprite.attr & nes::HORIZONTAL_FLIP) != 0 ? 7 - xIntoTile : xIntoTile;
+            uint yIntoTile = y - sprite.y;
+            yIntoTile = (sprite.attr & nes::VERTICAL_FLIP) != 0 ? 7 - yIntoTile : yIntoTile;
+            uint tileValue = sampleTile(tileSet.tiles[spriteTileIdx & 0xFF], xIntoTile, yIntoTile);
+
+            if (tileValue > 0) {
+                spriteIndexIntoPalette = tileValue;
+                spritePriority = (sprite.attr & nes::PRIORITY) == 0;
+                spritePaletteIndex = sprite.attr & nes::TILE_HIGH_BITS;
+            }
+        }
+
+        // Render background or sprite based on priority
+        if (indexIntoPalette == 0 || spritePriority) {
+            pallete = &memory.spritePalettes[spritePaletteIndex];
+            indexIntoPalette = spriteIndexIntoPalette;
+        }
+
+        const uint8_t* color = COLORS[pallete->data[indexIntoPalette] & 0x3F];
+        uint8_t* pixel = rgbaRow + x * BYTES_PER_PIXEL;
+        pixel[0] = color[0];
+        pixel[1] = color[1];
+        pixel[2] = color[2];
+        pixel[3] = 0xFF;
+    }
+}
+
+void NesSoftwareRenderer::renderFrame(const NesFrameTracker& frameTracker, uint8_t* rgba) {
+    for (uint y = 0; y < SCANLINES; ++y) {
+        renderScanline(frameTracker.getStateAt(y), y, rgba + y * WIDTH * BYTES_PER_PIXEL);
+    }
+}
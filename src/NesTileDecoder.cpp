@@ -0,0 +1,141 @@
+#include "NesTileDecoder.h"
+
+#include "UboUtil.h"
+
+#include <VulkanApp.h>
+
+#include <climits>
+
+namespace {
+    const VkDeviceSize PATTERN_TABLES_SIZE = sizeof(nes::PPUMemory::tileSets);
+}
+
+NesTileDecoder::NesTileDecoder(VulkanApp<F>& app,
+                               VkBuffer ppuBuffer,
+                               bool compactMemory,
+                               const UpdateSchedule& schedule,
+                               const std::vector<char>& decodeShaderCode) {
+    decodedImage_ = std::make_unique<ComputeImage>(app.getDevice(),
+                                                   app.getPhysicalDevice(),
+                                                   app.getGraphicsQueue(),
+                                                   app.getCommandPool(),
+                                                   IMAGE_WIDTH,
+                                                   IMAGE_HEIGHT,
+                                                   VK_FORMAT_R8_UINT);
+
+    // Filled with vkCmdUpdateBuffer right before each decode
+    Buffer<DecodeTileList>::create(tileBuffer_,
+                                   1,
+                                   VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                   app.getDevice(),
+                                   app.getPhysicalDevice());
+
+    decodeMaterial_ = std::make_unique<DecodeMat>(app.getDevice(),
+                                                  app.getPhysicalDevice(),
+                                                  std::vector<std::shared_ptr<Descriptor>>{
+                                                  createPpuMemoryDescriptor(ppuBuffer, compactMemory),
+                                                  std::make_shared<UniformBufferDescriptor<DecodeTileList, F>>(
+                                                      std::array<VkBuffer, F>{tileBuffer_->getBuffer()},
+                                                      VK_SHADER_STAGE_COMPUTE_BIT),
+                                                  std::make_shared<StorageImageDescriptor<F>>(
+                                                      VK_SHADER_STAGE_COMPUTE_BIT,
+                                                      std::array<VkImageView, F>{decodedImage_->getImageView()})
+                                                  },
+                                                  decodeShaderCode);
+
+    // Only PPU memory copies that reach into the pattern tables matter
+    for (const auto& [scanline, copies] : schedule) {
+        TileMask covered;
+        for (const auto& copy : copies) {
+            if (copy.bufferIndex != BufferIndex::PPU || copy.region.dstOffset >= PATTERN_TABLES_SIZE) {
+                continue;
+            }
+            VkDeviceSize end = std::min(copy.region.dstOffset + copy.region.size, PATTERN_TABLES_SIZE);
+            for (VkDeviceSize tile = copy.region.dstOffset / sizeof(nes::Tile);
+                 tile * sizeof(nes::Tile) < end;
+                 ++tile) {
+                covered.set(tile);
+            }
+        }
+        if (covered.any()) {
+            coveredTiles_[scanline] = covered;
+        }
+    }
+
+    pendingTiles_.set();
+}
+
+NesTileDecoder::~NesTileDecoder() = default;
+
+void NesTileDecoder::beginFrame() {
+    // Copies after the last dispatched batch still landed at the end of the previous frame
+    markCoveredTiles(markedThrough_, INT_MAX);
+    markedThrough_ = -1;
+}
+
+void NesTileDecoder::recordBeforeDispatch(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint firstScanline) {
+    markCoveredTiles(markedThrough_, static_cast<int>(firstScanline));
+    markedThrough_ = static_cast<int>(firstScanline);
+    if (pendingTiles_.none()) {
+        return;
+    }
+
+    pendingList_.count = 0;
+    for (uint tile = 0; tile < DecodeTileList::MAX_TILES; ++tile) {
+        if (pendingTiles_.test(tile)) {
+            pendingList_.tiles[pendingList_.count++] = tile;
+        }
+    }
+    pendingTiles_.reset();
+
+    // The previous decode & main pass may still be reading the tile list & image
+    VkMemoryBarrier readBarrier{};
+    readBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 1, &readBarrier, 0, nullptr, 0, nullptr);
+
+    // Upload only as much of the tile list as is in use, rounded up to 4 bytes
+    size_t uploadSize = offsetof(DecodeTileList, tiles) + pendingList_.count * sizeof(uint16_t);
+    uploadSize = (uploadSize + 3) & ~size_t(3);
+    vkCmdUpdateBuffer(commandBuffer, tileBuffer_->getBuffer(), 0, uploadSize, &pendingList_);
+
+    VkMemoryBarrier uploadBarrier{};
+    uploadBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    uploadBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    uploadBarrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 1, &uploadBarrier, 0, nullptr, 0, nullptr);
+
+    // One workgroup per tile
+    decodeMaterial_->setTileCount(pendingList_.count);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, decodeMaterial_->getPipeline());
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            decodeMaterial_->getPipelineLayout(),
+                            0, 1,
+                            decodeMaterial_->getDescriptorSet(frameIndex),
+                            0, 0);
+    auto dispatchSize = decodeMaterial_->getDispatchDimensions();
+    vkCmdDispatch(commandBuffer, dispatchSize.x, dispatchSize.y, dispatchSize.z);
+
+    // The main pass reads what was just decoded
+    VkMemoryBarrier decodeBarrier{};
+    decodeBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    decodeBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    decodeBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 1, &decodeBarrier, 0, nullptr, 0, nullptr);
+}
+
+void NesTileDecoder::markCoveredTiles(int fromScanline, int toScanline) {
+    auto it = fromScanline < 0 ? coveredTiles_.begin() : coveredTiles_.upper_bound(fromScanline);
+    for (; it != coveredTiles_.end() && static_cast<long>(it->first) <= toScanline; ++it) {
+        pendingTiles_ |= it->second;
+    }
+}
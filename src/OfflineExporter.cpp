@@ -0,0 +1,215 @@
+#include "OfflineExporter.h"
+#include "UboUtil.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+OfflineExporter::OfflineExporter(const std::string& ppuDumpPath,
+                                 const std::string& oamDumpPath,
+                                 nes::Control control,
+                                 std::function<UpdateList(MemoryUpdateComposer&)> composeUpdates)
+: ppu_(readStructFromFile<nes::PPUMemory>(ppuDumpPath)),
+  oam_(readStructFromFile<nes::OAM>(oamDumpPath)),
+  control_(control),
+  composeUpdates_(composeUpdates) {}
+
+std::unique_ptr<OfflineExporter::SessionClone> OfflineExporter::cloneSession() const {
+    // Only the staging layout & schedule are used, so no buffers are needed
+    MemoryUpdateComposer composer(VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE, offsetof(nes::Control, yOffset));
+    auto updates = composeUpdates_(composer);
+
+    auto clone = std::make_unique<SessionClone>();
+    clone->stagingData = composer.getStagingData();
+    clone->clock = std::make_unique<GameClock>(clone->stagingData.data(), clone->stagingData.size());
+    for (auto& update : updates) {
+        clone->clock->addUpdator(std::move(update));
+    }
+    clone->schedule = composer.getSchedule();
+    clone->frameTracker = std::make_unique<NesFrameTracker>(ppu_, oam_, control_, clone->schedule);
+    return clone;
+}
+
+void OfflineExporter::restoreSeed(SessionClone& clone, const ChunkSeed& seed) const {
+    memcpy(clone.stagingData.data(), seed.stagingData.data(), seed.stagingData.size());
+    StateReader reader(seed.clockState);
+    clone.clock->loadState(reader);
+
+    // Chunks a worker renders aren't contiguous, so the tracker starts over. Every
+    // scheduled copy is applied each frame, so replaying the frame before the chunk
+    // rebuilds the memory scanlines see ahead of their frame's first copy.
+    clone.frameTracker = std::make_unique<NesFrameTracker>(ppu_, oam_, control_, clone.schedule);
+    if (!seed.previousStagingData.empty()) {
+        clone.frameTracker->beginFrame(seed.previousStagingData.data());
+    }
+}
+
+void OfflineExporter::run(const OfflineExportConfig& config, const FrameSink& sink) {
+    if (config.frameCount == 0) {
+        return;
+    }
+    const uint upscaleFactor = config.upscale.factor;
+    if (upscaleFactor < 1 || upscaleFactor > 4) {
+        throw std::runtime_error("upscale factor must be between 1 and 4");
+    }
+    if (config.shaderVariant != "nes") {
+        throw std::runtime_error("offline export only renders the plain nes.comp, not " + config.shaderVariant);
+    }
+    uint threadCount = config.threadCount > 0 ? config.threadCount : std::max(1u, std::thread::hardware_concurrency());
+    uint chunkFrames = std::max(1u, config.chunkFrames);
+    size_t chunkCount = (config.frameCount + chunkFrames - 1) / chunkFrames;
+    // Bounds the frames held waiting for an earlier chunk
+    size_t maxChunksInFlight = 2 * threadCount;
+
+    // Stepping the updators is cheap next to rendering, so the state at the
+    // start of every chunk is found up front on this thread
+    std::vector<ChunkSeed> seeds(chunkCount);
+    {
+        auto seeder = cloneSession();
+        std::vector<uint8_t> previousStagingData;
+        for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+            uint64_t chunkStart = config.firstFrame + chunk * chunkFrames;
+            while (static_cast<uint64_t>(seeder->clock->getCurrentFrame()) < chunkStart) {
+                if (static_cast<uint64_t>(seeder->clock->getCurrentFrame()) + 1 == chunkStart) {
+                    previousStagingData = seeder->stagingData;
+                }
+                seeder->clock->step();
+            }
+            StateWriter writer;
+            seeder->clock->saveState(writer);
+            seeds[chunk] = ChunkSeed{seeder->stagingData, writer.getData(), previousStagingData};
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable chunkReady;
+    std::condition_variable chunkEmitted;
+    std::vector<std::vector<std::vector<uint8_t>>> results(chunkCount);
+    std::vector<bool> ready(chunkCount, false);
+    size_t emittedChunks = 0;
+    std::exception_ptr error;
+    std::atomic<size_t> nextChunk = 0;
+
+    const size_t frameSize = NesSoftwareRenderer::WIDTH * SCANLINES * NesSoftwareRenderer::BYTES_PER_PIXEL;
+
+    auto worker = [&]() {
+        try {
+            auto clone = cloneSession();
+            // Rendered here first when frames are upscaled
+            std::vector<uint8_t> rendered(upscaleFactor > 1 ? frameSize : 0);
+            for (size_t chunk = nextChunk++; chunk < chunkCount; chunk = nextChunk++) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    chunkEmitted.wait(lock, [&]() {
+                        return chunk < emittedChunks + maxChunksInFlight || error != nullptr;
+                    });
+                    if (error != nullptr) {
+                        return;
+                    }
+                }
+
+                // Restore the chunk's starting state into this worker's copy
+                restoreSeed(*clone, seeds[chunk]);
+
+                uint64_t framesInChunk = std::min<uint64_t>(chunkFrames, config.frameCount - chunk * chunkFrames);
+                std::vector<std::vector<uint8_t>> frames(framesInChunk);
+                for (uint64_t i = 0; i < framesInChunk; ++i) {
+                    if (i > 0) {
+                        clone->clock->step();
+                    }
+                    clone->frameTracker->beginFrame(clone->stagingData.data());
+                    frames[i].resize(frameSize * upscaleFactor * upscaleFactor);
+                    if (upscaleFactor == 1) {
+                        NesSoftwareRenderer::renderFrame(*clone->frameTracker, frames[i].data());
+                        continue;
+                    }
+                    NesSoftwareRenderer::renderFrame(*clone->frameTracker, rendered.data());
+                    FrameUpscaler::upscale(config.upscale,
+                                           rendered.data(),
+                                           NesSoftwareRenderer::WIDTH,
+                                           SCANLINES,
+                                           frames[i].data());
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    results[chunk] = std::move(frames);
+                    ready[chunk] = true;
+                }
+                chunkReady.notify_all();
+            }
+        } catch (...) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (error == nullptr) {
+                    error = std::current_exception();
+                }
+            }
+            chunkReady.notify_all();
+            chunkEmitted.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (uint i = 0; i < threadCount; ++i) {
+        workers.emplace_back(worker);
+    }
+
+    // Hand chunks to the sink in order as they complete
+    try {
+        for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+            std::vector<std::vector<uint8_t>> frames;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                chunkReady.wait(lock, [&]() {
+                    return ready[chunk] || error != nullptr;
+                });
+                if (error != nullptr) {
+                    break;
+                }
+                frames = std::move(results[chunk]);
+            }
+
+            for (size_t i = 0; i < frames.size(); ++i) {
+                sink(config.firstFrame + chunk * chunkFrames + i, frames[i]);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                emittedChunks += 1;
+            }
+            chunkEmitted.notify_all();
+        }
+    } catch (...) {
+        // Release any workers waiting on the sink before rethrowing
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (error == nullptr) {
+                error = std::current_exception();
+            }
+        }
+        chunkEmitted.notify_all();
+    }
+
+    for (auto& thread : workers) {
+        thread.join();
+    }
+    if (error != nullptr) {
+        std::rethrow_exception(error);
+    }
+}
+
+FrameSink OfflineExporter::scanlineCaptureSink(ScanlineCaptureWriter& writer) {
+    return [&writer](uint64_t, const std::vector<uint8_t>& rgba) {
+        writer.writeFrame(rgba.data());
+    };
+}
+
+FrameSink OfflineExporter::rawVideoSink(std::ostream& stream) {
+    return [&stream](uint64_t, const std::vector<uint8_t>& rgba) {
+        stream.write(reinterpret_cast<const char*>(rgba.data()), rgba.size());
+    };
+}
@@ -0,0 +1,211 @@
+#include "PpuBatchRenderer.h"
+
+#include <VulkanApp.h>
+#include <VkUtil.h>
+
+#include <stdexcept>
+
+PpuBatchRenderer::PpuBatchRenderer(VulkanApp<F>& app,
+                                   const std::vector<char>& computeShaderCode,
+                                   uint maxBatch,
+                                   uint linesPerGroup)
+: app_(app) {
+    if (maxBatch == 0 || linesPerGroup == 0) {
+        throw std::runtime_error("batch renderer needs at least one slot & one line per group");
+    }
+
+    slots_.resize(maxBatch);
+    for (auto& slot : slots_) {
+        Buffer<nes::PPUMemory>::create(slot.ppu,
+                                       1,
+                                       VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                       app_.getDevice(),
+                                       app_.getPhysicalDevice());
+        Buffer<nes::OAM>::create(slot.oam,
+                                 1,
+                                 VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                 app_.getDevice(),
+                                 app_.getPhysicalDevice());
+        Buffer<nes::Control>::create(slot.control,
+                                     1,
+                                     VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                     app_.getDevice(),
+                                     app_.getPhysicalDevice());
+        slot.frame = std::make_unique<ComputeImage>(app_.getDevice(),
+                                                    app_.getPhysicalDevice(),
+                                                    app_.getGraphicsQueue(),
+                                                    app_.getCommandPool(),
+                                                    WIDTH,
+                                                    SCANLINES,
+                                                    VK_FORMAT_R8G8B8A8_UNORM,
+                                                    VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+        slot.material = std::make_unique<FrameMat>(app_.getDevice(),
+                                                   app_.getPhysicalDevice(),
+                                                   std::vector<std::shared_ptr<Descriptor>>{
+                                                   std::make_shared<UniformBufferDescriptor<nes::PPUMemory, F>>(
+                                                       std::array<VkBuffer, F>{slot.ppu->getBuffer()},
+                                                       VK_SHADER_STAGE_COMPUTE_BIT),
+                                                   std::make_shared<UniformBufferDescriptor<nes::OAM, F>>(
+                                                       std::array<VkBuffer, F>{slot.oam->getBuffer()},
+                                                       VK_SHADER_STAGE_COMPUTE_BIT),
+                                                   std::make_shared<UniformBufferDescriptor<nes::Control, F>>(
+                                                       std::array<VkBuffer, F>{slot.control->getBuffer()},
+                                                       VK_SHADER_STAGE_COMPUTE_BIT),
+                                                   std::make_shared<StorageImageDescriptor<F>>(
+                                                       VK_SHADER_STAGE_COMPUTE_BIT,
+                                                       std::array<VkImageView, F>{slot.frame->getImageView()})
+                                                   },
+                                                   computeShaderCode,
+                                                   linesPerGroup);
+    }
+
+    Buffer<uint8_t>::create(uploadBuffer_,
+                            maxBatch * sizeof(NesMemoryState),
+                            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                            app_.getDevice(),
+                            app_.getPhysicalDevice());
+    Buffer<uint8_t>::create(readbackBuffer_,
+                            maxBatch * FRAME_SIZE,
+                            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                            app_.getDevice(),
+                            app_.getPhysicalDevice());
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(app_.getPhysicalDevice(), &properties);
+    if (properties.limits.timestampComputeAndGraphics) {
+        timestampPeriod_ = properties.limits.timestampPeriod;
+        VkQueryPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        poolInfo.queryCount = 2;
+        VK_SUCCESS_OR_THROW(vkCreateQueryPool(app_.getDevice(), &poolInfo, nullptr, &timestampPool_),
+                            "Failed to create timestamp query pool");
+    }
+}
+
+PpuBatchRenderer::~PpuBatchRenderer() {
+    if (timestampPool_ != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(app_.getDevice(), timestampPool_, nullptr);
+    }
+}
+
+void PpuBatchRenderer::render(const std::vector<const NesMemoryState*>& states,
+                              const std::vector<uint8_t*>& frames,
+                              uint scanlineCount) {
+    if (states.size() != frames.size() || states.size() > slots_.size()) {
+        throw std::runtime_error("batch does not fit the renderer");
+    }
+    if (scanlineCount == 0 || scanlineCount > SCANLINES) {
+        throw std::runtime_error("batch renderer scanline count out of range");
+    }
+    if (states.empty()) {
+        return;
+    }
+    size_t batchSize = states.size();
+
+    uploadBuffer_->mapAndExecute(0, batchSize * sizeof(NesMemoryState), [&](void* mappedData) {
+        auto* uploads = static_cast<NesMemoryState*>(mappedData);
+        for (size_t i = 0; i < batchSize; ++i) {
+            uploads[i] = *states[i];
+            // Dispatched from the top, 0 runs through the last scanline
+            uploads[i].control.yOffset = 0;
+            uploads[i].control.lineCount = scanlineCount == SCANLINES ? 0 : scanlineCount;
+        }
+    });
+
+    ComputeImage::submitImmediate(app_.getDevice(),
+                                  app_.getGraphicsQueue(),
+                                  app_.getCommandPool(),
+                                  [&](VkCommandBuffer commandBuffer) {
+        for (size_t i = 0; i < batchSize; ++i) {
+            VkDeviceSize base = i * sizeof(NesMemoryState);
+            VkBufferCopy ppuRegion{base + offsetof(NesMemoryState, ppu), 0, sizeof(nes::PPUMemory)};
+            VkBufferCopy oamRegion{base + offsetof(NesMemoryState, oam), 0, sizeof(nes::OAM)};
+            VkBufferCopy controlRegion{base + offsetof(NesMemoryState, control), 0, sizeof(nes::Control)};
+            vkCmdCopyBuffer(commandBuffer, uploadBuffer_->getBuffer(), slots_[i].ppu->getBuffer(), 1, &ppuRegion);
+            vkCmdCopyBuffer(commandBuffer, uploadBuffer_->getBuffer(), slots_[i].oam->getBuffer(), 1, &oamRegion);
+            vkCmdCopyBuffer(commandBuffer, uploadBuffer_->getBuffer(), slots_[i].control->getBuffer(), 1, &controlRegion);
+        }
+
+        // The dispatches read what was just uploaded
+        VkMemoryBarrier uploadBarrier{};
+        uploadBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        uploadBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        uploadBarrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0, 1, &uploadBarrier, 0, nullptr, 0, nullptr);
+
+        if (timestampPool_ != VK_NULL_HANDLE) {
+            vkCmdResetQueryPool(commandBuffer, timestampPool_, 0, 2);
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampPool_, 0);
+        }
+
+        // Frames don't depend on each other, so the dispatches can overlap
+        for (size_t i = 0; i < batchSize; ++i) {
+            auto& material = *slots_[i].material;
+            material.setScanlineCount(scanlineCount);
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, material.getPipeline());
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                                    material.getPipelineLayout(),
+                                    0, 1,
+                                    material.getDescriptorSet(0),
+                                    0, 0);
+            auto dispatchSize = material.getDispatchDimensions();
+            vkCmdDispatch(commandBuffer, dispatchSize.x, dispatchSize.y, dispatchSize.z);
+        }
+
+        if (timestampPool_ != VK_NULL_HANDLE) {
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool_, 1);
+        }
+
+        VkMemoryBarrier frameBarrier{};
+        frameBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        frameBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        frameBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             0, 1, &frameBarrier, 0, nullptr, 0, nullptr);
+
+        for (size_t i = 0; i < batchSize; ++i) {
+            VkBufferImageCopy region{};
+            region.bufferOffset = i * FRAME_SIZE;
+            region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+            region.imageExtent = {WIDTH, SCANLINES, 1};
+            vkCmdCopyImageToBuffer(commandBuffer,
+                                   slots_[i].frame->getImage(),
+                                   VK_IMAGE_LAYOUT_GENERAL,
+                                   readbackBuffer_->getBuffer(),
+                                   1, &region);
+        }
+    });
+
+    // The submission has completed, so the results are available
+    if (timestampPool_ != VK_NULL_HANDLE) {
+        uint64_t timestamps[2];
+        VkResult result = vkGetQueryPoolResults(app_.getDevice(),
+                                                timestampPool_,
+                                                0, 2,
+                                                sizeof(timestamps),
+                                                timestamps,
+                                                sizeof(uint64_t),
+                                                VK_QUERY_RESULT_64_BIT);
+        if (result == VK_SUCCESS) {
+            lastDispatchMicros_ = (timestamps[1] - timestamps[0]) * timestampPeriod_ / 1000.0;
+        }
+    }
+
+    readbackBuffer_->mapAndExecute(0, batchSize * FRAME_SIZE, [&](void* mappedData) {
+        auto* readback = static_cast<const uint8_t*>(mappedData);
+        for (size_t i = 0; i < batchSize; ++i) {
+            memcpy(frames[i], readback + i * FRAME_SIZE, FRAME_SIZE);
+        }
+    });
+}
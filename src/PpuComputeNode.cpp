@@ -1,115 +1,305 @@
 #include "PpuComputeNode.h"
 #include <VkUtil.h>
 
-// TODO: Submit single command buffer instead of multiple
-
-void PpuComputeNode::submit(RenderEvalContext& ctx) {
-    uint scanlinesRendered = 0;
-    bool wait = true;
-
-    auto updateItr = updates_.begin();
+PpuComputeNode::PpuComputeNode(VkDevice device,
+                               VkPhysicalDevice physicalDevice,
+                               VkQueue computeQueue,
+                               std::array<VkCommandBuffer, F> commandBuffers,
+                               std::vector<std::shared_ptr<Descriptor>> descriptors,
+                               const std::vector<char> & computeShaderCode,
+                               VkBuffer stagingBuffer,
+                               PpuProfiler* profiler)
+: RenderNode<F>(device), 
+  computeMaterial_(device, physicalDevice, descriptors, computeShaderCode), 
+  stagingBuffer_(stagingBuffer),
+  computeQueue_(computeQueue),
+  commandBuffers_(commandBuffers),
+  device_(device),
+  profiler_(profiler) {
+    if (profiler_ == nullptr) {
+        return;
+    }
 
-    // Dispatch the scanlines before the first update
-    if (updateItr != updates_.end() && updateItr->first > 0) {
-        uint scanlinesToRender = updateItr->first;
-        // If there's an update at 0 (pre-frame), then do nothing
-        if (scanlinesToRender > 0) {
-            computeMaterial_.setScanlineCount(scanlinesToRender), 
-            submitScanlineBatch(ctx, wait, false);
-            scanlinesRendered += scanlinesToRender;
-            wait = false;
-        }
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    if (!properties.limits.timestampComputeAndGraphics) {
+        return;
     }
+    timestampPeriod_ = properties.limits.timestampPeriod;
 
-    while(updateItr != updates_.end()) {
-        const auto& [updateScanline, update] = *updateItr;
+    // Two timestamps per scanline batch, for each frame in flight
+    VkQueryPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = 2 * MAX_SCANLINE_BATCHES * F;
+    VK_SUCCESS_OR_THROW(vkCreateQueryPool(device_, &poolInfo, nullptr, &timestampPool_),
+                        "Failed to create timestamp query pool");
+}
 
-        // Perform updates
-        applyUpdates(update);
+PpuComputeNode::~PpuComputeNode() {
+    if (timestampPool_ != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device_, timestampPool_, nullptr);
+    }
+}
 
-        // Dispatch scanlines until the next update (or end of frame if there are none)
-        uint renderUntil = (++updateItr == updates_.end()) ? SCANLINES : updateItr->first;
-        uint scanlinesToRender = renderUntil - scanlinesRendered;
+void PpuComputeNode::submit(RenderEvalContext& ctx) {
+    PpuProfiler::Span span(profiler_, "PpuComputeNode::submit");
+    if (timestampPool_ != VK_NULL_HANDLE) {
+        resolveTimestamps(ctx.frameIndex);
+        frameTimings_[ctx.frameIndex].frame = profiler_->getCurrentFrame();
+    }
 
-        computeMaterial_.setScanlineCount(scanlinesToRender);
+    // Before the damage source, which may read the same staging memory
+    if (stagingSource_) {
+        stagingBuffer_ = stagingSource_();
+    }
 
-        submitScanlineBatch(ctx, wait, scanlinesToRender + scanlinesRendered >= SCANLINES);
+    ScanlineMask dirtyScanlines = damageSource_ ? damageSource_() : ScanlineMask().set();
 
-        scanlinesRendered += scanlinesToRender;
-        wait = false;
+    for (auto& pass : scanlinePasses_) {
+        pass->beginFrame();
     }
 
-    // Ensure that all scanlines have been submitted
-    uint scanlinesToRender = SCANLINES - scanlinesRendered;
-    if (scanlinesToRender > 0) {
-        computeMaterial_.setScanlineCount(scanlinesToRender);
-        submitScanlineBatch(ctx, wait, true);
-        scanlinesRendered += scanlinesToRender;
+    static const std::vector<ScanlineWrite> noWrites;
+    const auto& writes = scanlineWriteSource_ ? scanlineWriteSource_() : noWrites;
+    ScanlineMask writeScanlines;
+    for (const auto& write : writes) {
+        if (write.scanline < SCANLINES) {
+            writeScanlines.set(write.scanline);
+        }
     }
 
-    // All scanlines should now have been submitted
-    assert(scanlinesRendered == SCANLINES);
-}
+    // Split the dirty scanlines into batches that never cross an update
+    struct Batch {
+        uint firstScanline;
+        uint scanlineCount;
+    };
+    std::vector<Batch> batches;
+    for (uint scanline = 0; scanline < SCANLINES; ++scanline) {
+        if (!dirtyScanlines.test(scanline)) {
+            continue;
+        }
+        bool extendsBatch = !batches.empty()
+            && batches.back().firstScanline + batches.back().scanlineCount == scanline
+            && updates_.find(scanline) == updates_.end()
+            && !writeScanlines.test(scanline);
+        if (extendsBatch) {
+            batches.back().scanlineCount += 1;
+        } else {
+            batches.push_back(Batch{scanline, 1});
+        }
+    }
+    // Still dispatch an empty batch so the frame's passes are recorded
+    if (batches.empty()) {
+        batches.push_back(Batch{0, 0});
+    }
 
-void PpuComputeNode::submitScanlineBatch(RenderEvalContext& ctx, bool wait, bool signal) {
-    // Start command buffer
+    // The whole frame goes into one command buffer, ordered by barriers
     auto& commandBuffer = commandBuffers_[ctx.frameIndex];
     VK_SUCCESS_OR_THROW(vkResetCommandBuffer(commandBuffer, 0),
                         "Failed to reset compute command buffer");
-    
     VkCommandBufferBeginInfo beginInfo{};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     VK_SUCCESS_OR_THROW(vkBeginCommandBuffer(commandBuffer, &beginInfo),
                         "Failed to begin compute commmand buffer");
 
-    // Bind pipeline & descriptor sets
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computeMaterial_.getPipeline());
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-                            computeMaterial_.getPipelineLayout(),
-                            0, 1,
-                            computeMaterial_.getDescriptorSet(ctx.frameIndex),
-                            0, 0);
-    // Dispatch workgroups
-    auto dispatchSize = computeMaterial_.getDispatchDimensions();
-    vkCmdDispatch(commandBuffer, dispatchSize.x, dispatchSize.y, dispatchSize.z);
-    
-    // End command buffer
-    vkEndCommandBuffer(commandBuffer);
-    
-    // Submit Work
+    for (auto& pass : scanlinePasses_) {
+        pass->recordBeforeUpdates(commandBuffer, ctx.frameIndex);
+    }
+
+    if (frameUpdateSource_) {
+        const auto& frameUpdates = frameUpdateSource_();
+        if (!frameUpdates.empty()) {
+            recordUpdates(commandBuffer, frameUpdates);
+        }
+    }
+
+    auto updateItr = updates_.begin();
+    size_t writeIdx = 0;
+    for (size_t i = 0; i < batches.size(); ++i) {
+        const auto& batch = batches[i];
+
+        // Perform every update that lands before this batch
+        for (; updateItr != updates_.end() && updateItr->first <= batch.firstScanline; ++updateItr) {
+            recordUpdates(commandBuffer, updateItr->second);
+        }
+
+        // Writes are recorded into the batch itself, after the updates
+        size_t firstWrite = writeIdx;
+        for (; writeIdx < writes.size() && writes[writeIdx].scanline <= batch.firstScanline; ++writeIdx) {}
+
+        computeMaterial_.setScanlineCount(batch.scanlineCount);
+        recordScanlineBatch(commandBuffer,
+                            ctx.frameIndex,
+                            batch.firstScanline,
+                            i + 1 == batches.size(),
+                            writes.data() + firstWrite,
+                            writeIdx - firstWrite);
+    }
+
+    // Later updates still need to land so memory is correct for the next frame
+    for (; updateItr != updates_.end(); ++updateItr) {
+        recordUpdates(commandBuffer, updateItr->second);
+    }
+
+    VK_SUCCESS_OR_THROW(vkEndCommandBuffer(commandBuffer),
+                        "Failed to end compute command buffer");
+
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &commandBuffer;
-    
     auto& waitSemaphores = RenderNode<F>::waitSemaphores_[ctx.frameIndex];
     submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
     submitInfo.pWaitSemaphores = waitSemaphores.data();
     std::array<VkSemaphore,1> signalSemaphores = {**RenderNode<F>::signalSemaphores_[ctx.frameIndex]};
     submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
     submitInfo.pSignalSemaphores = signalSemaphores.data();
-    
-    VK_SUCCESS_OR_THROW(vkQueueSubmit(computeQueue_,
-                                        1,
-                                        &submitInfo,
-                                        **RenderNode<F>::signalFences_[ctx.frameIndex]),
+
+    VK_SUCCESS_OR_THROW(vkQueueSubmit(computeQueue_, 1, &submitInfo, **RenderNode<F>::signalFences_[ctx.frameIndex]),
                         "Failed to submit compute");
+
+    if (profiler_ != nullptr) {
+        profiler_->countSubmit();
+    }
 }
 
-void PpuComputeNode::applyUpdate(const MemoryUpdate& update) {
-    // Begin command buffer
-    vkResetCommandBuffer(commandBuffers_[0], 0);
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    vkBeginCommandBuffer(commandBuffers_[0], &beginInfo);
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffers_[0];
+void PpuComputeNode::recordScanlineBatch(VkCommandBuffer commandBuffer,
+                                         uint32_t frameIndex,
+                                         uint firstScanline,
+                                         bool lastBatch,
+                                         const ScanlineWrite* writes,
+                                         size_t writeCount) {
+    auto dispatchSize = computeMaterial_.getDispatchDimensions();
+    uint scanlineCount = computeMaterial_.getScanlineCount();
+
+    // Bracket the batch with timestamps
+    auto& timings = frameTimings_[frameIndex];
+    uint32_t queryBase = 2 * (frameIndex * MAX_SCANLINE_BATCHES + timings.batches.size());
+    bool timed = timestampPool_ != VK_NULL_HANDLE && timings.batches.size() < MAX_SCANLINE_BATCHES;
+    if (timed) {
+        if (timings.batches.empty()) {
+            vkCmdResetQueryPool(commandBuffer, timestampPool_, 2 * frameIndex * MAX_SCANLINE_BATCHES, 2 * MAX_SCANLINE_BATCHES);
+        }
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampPool_, queryBase);
+        timings.batches.push_back(BatchTiming{firstScanline, scanlineCount});
+    }
+
+    // Point the shader at the first scanline of this batch, which may not line up with an update
+    if (controlBuffer_ != VK_NULL_HANDLE || writeCount > 0) {
+        // Also after the update copies, which stage a yOffset of their own
+        VkMemoryBarrier readBarrier{};
+        readBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        readBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        readBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             0, 1, &readBarrier, 0, nullptr, 0, nullptr);
+
+        // Before the yOffset, in case a write covers it
+        for (size_t i = 0; i < writeCount; ++i) {
+            vkCmdUpdateBuffer(commandBuffer, writes[i].dst, writes[i].offset, writes[i].size, writes[i].data);
+        }
+
+        if (controlBuffer_ != VK_NULL_HANDLE) {
+            // Multi-line variants stop at the end of the batch rather than the last workgroup
+            uint32_t yOffset = firstScanline | (scanlineCount << 8);
+            vkCmdUpdateBuffer(commandBuffer, controlBuffer_, yOffsetLocation_, sizeof(yOffset), &yOffset);
+        }
+    }
+
+    // Updates & writes recorded since the last batch are read from here on
+    VkMemoryBarrier writeBarrier{};
+    writeBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    writeBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    writeBarrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 1, &writeBarrier, 0, nullptr, 0, nullptr);
+
+    if (dispatchSize.y > 0) {
+        for (auto& pass : scanlinePasses_) {
+            pass->recordBeforeDispatch(commandBuffer, frameIndex, firstScanline);
+        }
+    }
+
+    // Bind pipeline & descriptor sets, again for every batch as passes bind their own
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computeMaterial_.getPipeline());
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            computeMaterial_.getPipelineLayout(),
+                            0, 1,
+                            computeMaterial_.getDescriptorSet(frameIndex),
+                            0, 0);
+    // Dispatch workgroups
+    vkCmdDispatch(commandBuffer, dispatchSize.x, dispatchSize.y, dispatchSize.z);
+
+    if (lastBatch) {
+        for (auto& pass : scanlinePasses_) {
+            pass->recordAfterFrame(commandBuffer, frameIndex);
+        }
+    }
+
+    if (timed) {
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool_, queryBase + 1);
+    }
+
+    if (profiler_ != nullptr) {
+        profiler_->countScanlineBatch();
+    }
+}
+
+void PpuComputeNode::recordUpdates(VkCommandBuffer commandBuffer, const std::vector<MemoryUpdate>& updates) {
+    // Earlier batches may still be reading what gets copied over, or writing their yOffset
+    VkMemoryBarrier readBarrier{};
+    readBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    readBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    readBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 1, &readBarrier, 0, nullptr, 0, nullptr);
+
+    for (const auto& update : updates) {
+        vkCmdCopyBuffer(commandBuffer, stagingBuffer_, update.dst, update.regions.size(), update.regions.data());
 
-    vkCmdCopyBuffer(commandBuffers_[0], stagingBuffer_, update.dst, update.regions.size(), update.regions.data());
-    vkEndCommandBuffer(commandBuffers_[0]);
-    
-    // Submit command buffer
-    vkQueueSubmit(computeQueue_, 1, &submitInfo, VK_NULL_HANDLE);
+        if (profiler_ != nullptr) {
+            size_t copyBytes = 0;
+            for (const auto& region : update.regions) {
+                copyBytes += region.size;
+            }
+            profiler_->countMemoryUpdate(copyBytes);
+        }
+    }
+}
+
+void PpuComputeNode::resolveTimestamps(uint32_t frameIndex) {
+    auto& timings = frameTimings_[frameIndex];
+    if (timings.batches.empty()) {
+        return;
+    }
+
+    // This frame index's fence has been waited on, so the results should be available
+    std::vector<uint64_t> timestamps(2 * timings.batches.size());
+    VkResult result = vkGetQueryPoolResults(device_,
+                                            timestampPool_,
+                                            2 * frameIndex * MAX_SCANLINE_BATCHES,
+                                            static_cast<uint32_t>(timestamps.size()),
+                                            timestamps.size() * sizeof(uint64_t),
+                                            timestamps.data(),
+                                            sizeof(uint64_t),
+                                            VK_QUERY_RESULT_64_BIT);
+    if (result == VK_SUCCESS) {
+        double microsPerTick = timestampPeriod_ / 1000.0;
+        for (size_t i = 0; i < timings.batches.size(); ++i) {
+            const auto& batch = timings.batches[i];
+            profiler_->recordGpuBatch(timings.frame,
+                                      batch.firstScanline,
+                                      batch.scanlineCount,
+                                      (timestamps[2 * i] - timestamps[0]) * microsPerTick,
+                                      (timestamps[2 * i + 1] - timestamps[2 * i]) * microsPerTick);
+        }
+    }
+    timings.batches.clear();
 }
\ No newline at end of file
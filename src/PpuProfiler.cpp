@@ -0,0 +1,84 @@
+#include "PpuProfiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+void PpuProfiler::recordGpuBatch(uint64_t frame,
+                                 uint firstScanline,
+                                 uint scanlineCount,
+                                 double offsetMicros,
+                                 double durationMicros) {
+    auto& stats = history_[frame % FRAME_HISTORY];
+    if (stats.frame != frame) {
+        // Frame has already been evicted from the history
+        return;
+    }
+    stats.gpuResolved = true;
+    stats.gpuMicros += durationMicros;
+
+    // GPU timestamps are placed relative to the start of the frame on the CPU timeline
+    recordEvent(TraceEvent{"scanline batch",
+                           frame,
+                           stats.startMicros + offsetMicros,
+                           durationMicros,
+                           GPU_TRACK,
+                           firstScanline,
+                           scanlineCount});
+}
+
+std::vector<FrameStats> PpuProfiler::getHistory() const {
+    std::vector<FrameStats> frames;
+    uint64_t first = currentFrame_ >= FRAME_HISTORY ? currentFrame_ - FRAME_HISTORY + 1 : 1;
+    for (uint64_t frame = first; frame <= currentFrame_; ++frame) {
+        if (const FrameStats* stats = getFrameStats(frame)) {
+            frames.push_back(*stats);
+        }
+    }
+    return frames;
+}
+
+bool PpuProfiler::writeChromeTrace(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    out << std::fixed << std::setprecision(3);
+
+    out << "{\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"vk_ppu\"}},\n";
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << CPU_TRACK << ",\"args\":{\"name\":\"CPU\"}},\n";
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << GPU_TRACK << ",\"args\":{\"name\":\"GPU\"}}";
+
+    // Per-frame counters
+    for (const auto& stats : getHistory()) {
+        out << ",\n{\"name\":\"frame\",\"ph\":\"C\",\"pid\":0,\"ts\":" << stats.startMicros
+            << ",\"args\":{\"updatorsRun\":" << stats.updatorsRun
+            << ",\"updatorBytes\":" << stats.updatorBytes
+            << ",\"memoryUpdates\":" << stats.memoryUpdates
+            << ",\"copyBytes\":" << stats.copyBytes
+            << ",\"queueSubmits\":" << stats.queueSubmits
+            << ",\"scanlineBatches\":" << stats.scanlineBatches
+            << "}}";
+    }
+
+    // Spans, oldest first
+    size_t eventCount = std::min(traceHead_, traceEvents_.size());
+    for (size_t i = traceHead_ - eventCount; i < traceHead_; ++i) {
+        const auto& event = traceEvents_[i % traceEvents_.size()];
+        out << ",\n{\"name\":\"" << event.name
+            << "\",\"cat\":\"" << (event.track == GPU_TRACK ? "gpu" : "cpu")
+            << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.track
+            << ",\"ts\":" << event.startMicros
+            << ",\"dur\":" << event.durationMicros
+            << ",\"args\":{\"frame\":" << event.frame;
+        if (event.track == GPU_TRACK) {
+            out << ",\"firstScanline\":" << event.firstScanline
+                << ",\"scanlineCount\":" << event.scanlineCount;
+        }
+        out << "}}";
+    }
+
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+}
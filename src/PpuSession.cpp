@@ -14,17 +14,51 @@
 #include <FileUtil.h>
 
 #include <glm/ext.hpp>
+#include <optional>
+#include <stdexcept>
 
 #include "NesMemory.h"
+#include "NesAddressMap.h"
 #include "UboUtil.h"
 #include "MemoryUpdateComposer.h"
 #include "PpuComputeNode.h"
 #include "GameClock.h"
+#include "NesFrameTracker.h"
+#include "NesBackgroundCache.h"
+#include "NesTileDecoder.h"
+#include "SessionTimeline.h"
+#include "SimulationThread.h"
+#include "ShaderAutotuner.h"
+#include "FrameUpscalePass.h"
+
+static std::vector<uint8_t> bytesOf(const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    return std::vector<uint8_t>(bytes, bytes + size);
+}
+
+// Variants of a shader are built as <name>_<feature>_<feature>.comp.spirv, see the Makefile
+static std::string shaderVariantPath(const std::string& shaderPath, const std::vector<std::string>& features) {
+    static const std::string extension = ".comp.spirv";
+    if (shaderPath.size() < extension.size() 
+        || shaderPath.compare(shaderPath.size() - extension.size(), extension.size(), extension) != 0) {
+        return shaderPath;
+    }
+    std::string variantPath = shaderPath.substr(0, shaderPath.size() - extension.size());
+    for (const auto& feature : features) {
+        variantPath += "_" + feature;
+    }
+    return variantPath + extension;
+}
 
 template<typename PPUMemory, typename OAM, typename Control>
 PpuSession<PPUMemory, OAM, Control>::PpuSession(PpuSessionConfig config)
 : config_(config), 
-  app_(std::make_unique<VulkanApp<F>>(SCANLINES, config.screenWidth)) {}
+  app_(std::make_unique<VulkanApp<F>>(SCANLINES * config.upscale.factor, config.screenWidth * config.upscale.factor)),
+  profiler_(std::make_unique<PpuProfiler>(!config.traceOutputPath.empty())) {
+    if (config.upscale.factor < 1 || config.upscale.factor > 4) {
+        throw std::runtime_error("upscale factor must be between 1 and 4");
+    }
+}
 
 template<typename PPUMemory, typename OAM, typename Control>
 PpuSession<PPUMemory, OAM, Control>::~PpuSession() = default;
@@ -32,6 +66,10 @@ PpuSession<PPUMemory, OAM, Control>::~PpuSession() = default;
 template<typename PPUMemory, typename OAM, typename Control>
 void PpuSession<PPUMemory, OAM, Control>::run() {
     app_->run();
+
+    if (profiler_->isTraceEnabled()) {
+        profiler_->writeChromeTrace(config_.traceOutputPath);
+    }
 }
 
 template<typename PPUMemory, typename OAM, typename Control>
@@ -40,12 +78,48 @@ void PpuSession<PPUMemory, OAM, Control>::init(const std::string& ppuDumpPath,
               Control control,
               const std::string& shaderPath,
               std::function<UpdateList(MemoryUpdateComposer&)> composeUpdates) {
+    init(readStructFromFile<PPUMemory>(ppuDumpPath),
+         readStructFromFile<OAM>(oamDumpPath),
+         control,
+         shaderPath,
+         composeUpdates);
+}
+
+template<typename PPUMemory, typename OAM, typename Control>
+void PpuSession<PPUMemory, OAM, Control>::init(const PPUMemory& ppuMemory,
+              const OAM& oam,
+              Control control,
+              const std::string& shaderPath,
+              std::function<UpdateList(MemoryUpdateComposer&)> composeUpdates) {
     app_->init();
 
     // Create compute memory buffers
-    ppuUbo_ = createUboFromFile<PPUMemory>(ppuDumpPath, *app_);
-    oamUbo_ = createUboFromFile<OAM>(oamDumpPath, *app_);
-    controlUbo_ = createUboFromStruct<Control>(control, *app_);
+    // Memory buffers are read back when taking snapshots
+    std::optional<NesAddressMap> ppuAddressMap;
+    nes::PackedPPUMemory packedPpu{};
+    if constexpr (std::is_same_v<PPUMemory, nes::PPUMemory>) {
+        if (config_.compactMemory) {
+            if (config_.mirroring == nes::FOUR_SCREEN) {
+                throw std::runtime_error("compact memory needs a mirrored nametable layout");
+            }
+            ppuAddressMap.emplace(config_.mirroring);
+            if (!ppuAddressMap->matches(ppuMemory)) {
+                throw std::runtime_error("PPU dump's nametables don't match the configured mirroring");
+            }
+            packedPpu = ppuAddressMap->pack(ppuMemory);
+            packedPpuUbo_ = createUboFromStruct<nes::PackedPPUMemory>(packedPpu,
+                                                                      *app_,
+                                                                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                                                      VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+        }
+    }
+    if (!packedPpuUbo_) {
+        ppuUbo_ = createUboFromStruct<PPUMemory>(ppuMemory, *app_, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    }
+    VkBuffer ppuBuffer = packedPpuUbo_ ? packedPpuUbo_->getBuffer() : ppuUbo_->getBuffer();
+    VkDeviceSize ppuBufferSize = packedPpuUbo_ ? sizeof(nes::PackedPPUMemory) : sizeof(PPUMemory);
+    oamUbo_ = createUboFromStruct<OAM>(oam, *app_, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    controlUbo_ = createUboFromStruct<Control>(control, *app_, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
 
     // Construct M, V, P matrices
     // Create MVP UBO for graphics
@@ -66,6 +140,22 @@ void PpuSession<PPUMemory, OAM, Control>::init(const std::string& ppuDumpPath,
                            app_->getCommandPool(), 
                            app_->getDevice(), 
                            app_->getPhysicalDevice());
+    if (config_.upscale.factor > 1) {
+        Image::createEmptyRGBA(upscaledTexture_,
+                               config_.screenWidth * config_.upscale.factor,
+                               SCANLINES * config_.upscale.factor,
+                               app_->getGraphicsQueue(),
+                               app_->getCommandPool(),
+                               app_->getDevice(),
+                               app_->getPhysicalDevice());
+        upscalePass_ = std::make_shared<FrameUpscalePass>(*app_,
+                                                          frameTexture_->getImageView(),
+                                                          upscaledTexture_->getImageView(),
+                                                          config_.screenWidth * config_.upscale.factor,
+                                                          SCANLINES * config_.upscale.factor,
+                                                          config_.upscale,
+                                                          readFile(pathPrefix + "shaders/spirv/upscale.comp.spirv"));
+    }
     VulkanSampler::createWithModeAndFilter(sampler_,
                                             VK_SAMPLER_ADDRESS_MODE_REPEAT,
                                             VK_FILTER_NEAREST,
@@ -73,41 +163,173 @@ void PpuSession<PPUMemory, OAM, Control>::init(const std::string& ppuDumpPath,
                                             app_->getPhysicalDevice()); 
     
     // Set up update mappings
-    MemoryUpdateComposer composer(ppuUbo_->getBuffer(), oamUbo_->getBuffer(), controlUbo_->getBuffer(), config_.yOffsetLocation);
+    MemoryUpdateComposer composer(ppuBuffer, oamUbo_->getBuffer(), controlUbo_->getBuffer(), config_.yOffsetLocation);
+    if (ppuAddressMap) {
+        composer.setPpuAddressMap(*ppuAddressMap);
+    }
     auto clockUpdates = composeUpdates(composer);
-    // Create staging buffer for updates to our GPU memory
-    stagingBuffer_ = composer.produceStagingBuffer(*app_);
+    if (config_.simulationThread) {
+        if (config_.keyframeInterval > 0) {
+            throw std::runtime_error("keyframes need the game clock on the render thread");
+        }
+        // The compute node reads scanline writes & frame updates on the render thread as updators rebuild them
+        if (composer.hasScanlineWriteSource() || composer.hasFrameUpdateSource()) {
+            throw std::runtime_error("scanline writes need the game clock on the render thread");
+        }
+        // Staging memory is owned by the simulation, which starts stepping right away
+        simulation_ = std::make_unique<SimulationThread>(*app_,
+                                                         composer.getStagingData(),
+                                                         std::move(clockUpdates),
+                                                         config_.updatorThreads,
+                                                         profiler_.get());
+    } else {
+        // Create staging buffer for updates to our GPU memory
+        stagingBuffer_ = composer.produceStagingBuffer(*app_);
+    }
+    Buffer<uint8_t>& stagingBuffer = simulation_ ? simulation_->getFront() : *stagingBuffer_;
+    // NES specific passes that follow the composed updates on the CPU
+    std::vector<std::string> shaderFeatures;
+    uint linesPerGroup = 1;
+    if constexpr (std::is_same_v<PPUMemory, nes::PPUMemory>) {
+        // The cache & decoder passes read PPU memory in the same layout as the main pass
+        std::vector<std::string> passFeatures;
+        if (config_.compactMemory) {
+            passFeatures.push_back("compact");
+        }
+        if (config_.incrementalRendering || config_.backgroundCache) {
+            frameTracker_ = std::make_unique<NesFrameTracker>(ppuMemory, oam, control, composer.getSchedule());
+        }
+        if (config_.backgroundCache) {
+            backgroundCache_ = std::make_shared<NesBackgroundCache>(*app_,
+                                                                    ppuBuffer,
+                                                                    config_.compactMemory,
+                                                                    *frameTracker_,
+                                                                    readFile(pathPrefix + shaderVariantPath("shaders/spirv/bg_cache.comp.spirv", passFeatures)));
+            shaderFeatures.push_back("bgcache");
+        }
+        if (config_.decodedTiles) {
+            tileDecoder_ = std::make_shared<NesTileDecoder>(*app_,
+                                                            ppuBuffer,
+                                                            config_.compactMemory,
+                                                            composer.getSchedule(),
+                                                            readFile(pathPrefix + shaderVariantPath("shaders/spirv/tile_decode.comp.spirv", passFeatures)));
+            shaderFeatures.push_back("decoded");
+        }
+        if (config_.compactMemory) {
+            shaderFeatures.push_back("compact");
+        }
+        if (config_.autotuneShader) {
+            // Tuned against the plain shader, the chosen features stack on top of the cache's
+            ShaderAutotuner autotuner(*app_, pathPrefix + "shaders/spirv/autotune.txt");
+            auto variant = autotuner.select(NesMemoryState{ppuMemory, oam, control});
+            shaderFeatures.insert(shaderFeatures.end(), variant.features.begin(), variant.features.end());
+            linesPerGroup = variant.linesPerGroup;
+        }
+    }
+
+    // Compute descriptors
+    std::vector<std::shared_ptr<Descriptor>> computeDesc = {
+        packedPpuUbo_ 
+            ? createPpuMemoryDescriptor(ppuBuffer, true)
+            : std::make_shared<UniformBufferDescriptor<PPUMemory, F>>(
+                std::array<VkBuffer, F>{ppuBuffer}, 
+                VK_SHADER_STAGE_COMPUTE_BIT),
+        std::make_shared<UniformBufferDescriptor<OAM, F>>(
+            std::array<VkBuffer, F>{oamUbo_->getBuffer()}, 
+            VK_SHADER_STAGE_COMPUTE_BIT),
+        std::make_shared<UniformBufferDescriptor<Control, F>>(
+            std::array<VkBuffer, F>{controlUbo_->getBuffer()}, 
+            VK_SHADER_STAGE_COMPUTE_BIT),
+        std::make_shared<StorageImageDescriptor<F>>(
+            VK_SHADER_STAGE_COMPUTE_BIT, 
+            std::array<VkImageView, F>{frameTexture_->getImageView()})
+    };
+    if (backgroundCache_) {
+        computeDesc.push_back(std::make_shared<StorageImageDescriptor<F>>(
+            VK_SHADER_STAGE_COMPUTE_BIT,
+            std::array<VkImageView, F>{backgroundCache_->getImageView()}));
+    }
+    if (tileDecoder_) {
+        computeDesc.push_back(std::make_shared<StorageImageDescriptor<F>>(
+            VK_SHADER_STAGE_COMPUTE_BIT,
+            std::array<VkImageView, F>{tileDecoder_->getImageView()}));
+    }
+
     // Create compute node that controls our PPU rendering
     auto ppuCompute = std::make_unique<PpuComputeNode>(app_->getDevice(),
                                                        app_->getPhysicalDevice(),
                                                        app_->getComputeQueue(),
                                                        app_->getComputeCommandBuffers(),
-                                                       // Compute descriptors
-                                                       std::vector<std::shared_ptr<Descriptor>>{
-                                                       std::make_shared<UniformBufferDescriptor<PPUMemory, F>>(
-                                                           std::array<VkBuffer, F>{ppuUbo_->getBuffer()}, 
-                                                           VK_SHADER_STAGE_COMPUTE_BIT),
-                                                       std::make_shared<UniformBufferDescriptor<OAM, F>>(
-                                                           std::array<VkBuffer, F>{oamUbo_->getBuffer()}, 
-                                                           VK_SHADER_STAGE_COMPUTE_BIT),
-                                                       std::make_shared<UniformBufferDescriptor<Control, F>>(
-                                                           std::array<VkBuffer, F>{controlUbo_->getBuffer()}, 
-                                                           VK_SHADER_STAGE_COMPUTE_BIT),
-                                                       std::make_shared<StorageImageDescriptor<F>>(
-                                                           VK_SHADER_STAGE_COMPUTE_BIT, 
-                                                           std::array<VkImageView, F>{frameTexture_->getImageView()})
-                                                       },
-                                                       readFile(pathPrefix + shaderPath),
-                                                       stagingBuffer_->getBuffer());
+                                                       computeDesc,
+                                                       readFile(pathPrefix + shaderVariantPath(shaderPath, shaderFeatures)),
+                                                       stagingBuffer.getBuffer(),
+                                                       profiler_.get());
+    ppuCompute->setLinesPerGroup(linesPerGroup);
     // Add our composed updates to the compute node
     composer.populateUpdates(*ppuCompute);
+    if (simulation_) {
+        // With one frame in flight, the last frame's copies out of the old snapshot are done by now
+        ppuCompute->setStagingSource([this]() {
+            return simulation_->acquireLatest().getBuffer();
+        });
+    }
+
+    if (frameTracker_) {
+        // Only skip scanlines that haven't changed if asked to, the tracker is still needed for the cache
+        bool incremental = config_.incrementalRendering;
+        size_t stagingSize = composer.getStagingSize();
+        ppuCompute->setDamageSource([this, stagingSize, incremental]() {
+            auto& staging = simulation_ ? simulation_->getFront() : *stagingBuffer_;
+            staging.mapAndExecute(0, stagingSize, [this](void* mappedData) {
+                frameTracker_->beginFrame(static_cast<const uint8_t*>(mappedData));
+            });
+            return incremental ? frameTracker_->getDirtyScanlines() : ScanlineMask().set();
+        });
+    }
+    if (backgroundCache_) {
+        ppuCompute->addScanlinePass(backgroundCache_);
+    }
+    if (tileDecoder_) {
+        ppuCompute->addScanlinePass(tileDecoder_);
+    }
+    if (upscalePass_) {
+        ppuCompute->addScanlinePass(upscalePass_);
+    }
+
+    // Start each frame's counters before anything else runs
+    app_->addPreDrawCallback(profiler_->getCallback());
 
     // Initialize the game clock
-    gameClock_ = std::make_unique<GameClock>(*stagingBuffer_);
-    for (auto& clockUpdate : clockUpdates) {
-        gameClock_->addUpdator(std::move(clockUpdate));
+    if (!simulation_) {
+        gameClock_ = std::make_unique<GameClock>(*stagingBuffer_,
+                                                 composer.getStagingSize(),
+                                                 profiler_.get(),
+                                                 config_.updatorThreads);
+        for (auto& clockUpdate : clockUpdates) {
+            gameClock_->addUpdator(std::move(clockUpdate));
+        }
+        app_->addPreDrawCallback(gameClock_->getCallback());
+    }
+
+    if (config_.keyframeInterval > 0) {
+        auto initialPpu = packedPpuUbo_ ? bytesOf(&packedPpu, sizeof(packedPpu)) : bytesOf(&ppuMemory, sizeof(PPUMemory));
+        timeline_ = std::make_shared<SessionTimeline>(*app_,
+                                                      *gameClock_,
+                                                      *stagingBuffer_,
+                                                      composer.getStagingSize(),
+                                                      std::array<SnapshotBuffer, 3>{
+                                                          SnapshotBuffer{ppuBuffer, ppuBufferSize},
+                                                          SnapshotBuffer{oamUbo_->getBuffer(), sizeof(OAM)},
+                                                          SnapshotBuffer{controlUbo_->getBuffer(), sizeof(Control)}},
+                                                      std::array<std::vector<uint8_t>, 3>{
+                                                          std::move(initialPpu),
+                                                          bytesOf(&oam, sizeof(OAM)),
+                                                          bytesOf(&control, sizeof(Control))},
+                                                      config_.keyframeInterval,
+                                                      profiler_.get());
+        app_->addPreDrawCallback(timeline_->getCallback());
+        ppuCompute->addScanlinePass(timeline_);
     }
-    app_->addPreDrawCallback(gameClock_->getCallback());
 
 
     // Graphics descriptors
@@ -117,7 +339,7 @@ void PpuSession<PPUMemory, OAM, Control>::init(const std::string& ppuDumpPath,
             VK_SHADER_STAGE_VERTEX_BIT),
         std::make_shared<CombinedImageSamplerDescriptor<F>>(
             VK_SHADER_STAGE_FRAGMENT_BIT, 
-            std::array<VkImageView, F>{frameTexture_->getImageView()},
+            std::array<VkImageView, F>{(upscaledTexture_ ? upscaledTexture_ : frameTexture_)->getImageView()},
             **sampler_)
     };
 
@@ -0,0 +1,399 @@
+#include "PpuSessionHost.h"
+#include "NesAddressMap.h"
+#include "UboUtil.h"
+
+#include <VulkanApp.h>
+
+#include <algorithm>
+#include <optional>
+
+PpuSessionHost::PpuSessionHost(VulkanApp<F>& app,
+                               const std::vector<char>& computeShaderCode,
+                               uint maxSessions,
+                               uint updatorThreads,
+                               bool compactMemory)
+: app_(app),
+  device_(app.getDevice()),
+  maxSessions_(maxSessions),
+  compactMemory_(compactMemory),
+  threadPool_(updatorThreads) {
+    createPipeline(computeShaderCode, maxSessions);
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = app_.getCommandPool();
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    VK_SUCCESS_OR_THROW(vkAllocateCommandBuffers(device_, &allocInfo, &commandBuffer_),
+                        "Failed to allocate session host command buffer");
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VK_SUCCESS_OR_THROW(vkCreateFence(device_, &fenceInfo, nullptr, &submitFence_),
+                        "Failed to create session host fence");
+}
+
+PpuSessionHost::~PpuSessionHost() {
+    flush();
+    sessions_.clear();
+    vkDestroyFence(device_, submitFence_, nullptr);
+    vkFreeCommandBuffers(device_, app_.getCommandPool(), 1, &commandBuffer_);
+    vkDestroyDescriptorPool(device_, descriptorPool_, nullptr);
+    vkDestroyPipeline(device_, pipeline_, nullptr);
+    vkDestroyPipelineLayout(device_, pipelineLayout_, nullptr);
+    vkDestroyDescriptorSetLayout(device_, descriptorSetLayout_, nullptr);
+}
+
+void PpuSessionHost::createPipeline(const std::vector<char>& computeShaderCode, uint maxSessions) {
+    // Matches the bindings of nes.comp without BG_CACHE
+    std::array<VkDescriptorSetLayoutBinding, 4> bindings{};
+    for (uint32_t i = 0; i < bindings.size(); ++i) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = i < 3 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = bindings.size();
+    layoutInfo.pBindings = bindings.data();
+    VK_SUCCESS_OR_THROW(vkCreateDescriptorSetLayout(device_, &layoutInfo, nullptr, &descriptorSetLayout_),
+                        "Failed to create session host descriptor set layout");
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout_;
+    VK_SUCCESS_OR_THROW(vkCreatePipelineLayout(device_, &pipelineLayoutInfo, nullptr, &pipelineLayout_),
+                        "Failed to create session host pipeline layout");
+
+    VkShaderModuleCreateInfo moduleInfo{};
+    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.codeSize = computeShaderCode.size();
+    moduleInfo.pCode = reinterpret_cast<const uint32_t*>(computeShaderCode.data());
+    VkShaderModule shaderModule;
+    VK_SUCCESS_OR_THROW(vkCreateShaderModule(device_, &moduleInfo, nullptr, &shaderModule),
+                        "Failed to create session host shader module");
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = pipelineLayout_;
+    VkResult result = vkCreateComputePipelines(device_, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline_);
+    vkDestroyShaderModule(device_, shaderModule, nullptr);
+    VK_SUCCESS_OR_THROW(result, "Failed to create session host pipeline");
+
+    // Sets are freed as sessions leave, so the pool only ever needs room for maxSessions
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0] = {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3 * maxSessions};
+    poolSizes[1] = {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, maxSessions};
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+    poolInfo.maxSets = maxSessions;
+    poolInfo.poolSizeCount = poolSizes.size();
+    poolInfo.pPoolSizes = poolSizes.data();
+    VK_SUCCESS_OR_THROW(vkCreateDescriptorPool(device_, &poolInfo, nullptr, &descriptorPool_),
+                        "Failed to create session host descriptor pool");
+}
+
+PpuSessionHost::SessionId PpuSessionHost::addSession(const nes::PPUMemory& ppu,
+                                                     const nes::OAM& oam,
+                                                     const nes::Control& control,
+                                                     nes::Mirroring mirroring,
+                                                     std::function<UpdateList(MemoryUpdateComposer&)> composeUpdates,
+                                                     FrameSink sink) {
+    if (sessions_.size() >= maxSessions_) {
+        throw std::runtime_error("session host is full");
+    }
+
+    auto session = std::make_unique<HostedSession>();
+    session->id = nextSessionId_++;
+    std::optional<NesAddressMap> ppuAddressMap;
+    if (compactMemory_) {
+        if (mirroring == nes::FOUR_SCREEN) {
+            throw std::runtime_error("compact memory needs a mirrored nametable layout");
+        }
+        ppuAddressMap.emplace(mirroring);
+        if (!ppuAddressMap->matches(ppu)) {
+            throw std::runtime_error("PPU dump's nametables don't match the session's mirroring");
+        }
+        session->packedPpu = createUboFromStruct<nes::PackedPPUMemory>(ppuAddressMap->pack(ppu), app_);
+        session->ppuBuffer = session->packedPpu->getBuffer();
+    } else {
+        session->ppu = createUboFromStruct<nes::PPUMemory>(ppu, app_);
+        session->ppuBuffer = session->ppu->getBuffer();
+    }
+    session->oam = createUboFromStruct<nes::OAM>(oam, app_);
+    session->control = createUboFromStruct<nes::Control>(control, app_);
+    session->frame = std::make_unique<ComputeImage>(device_,
+                                                    app_.getPhysicalDevice(),
+                                                    app_.getGraphicsQueue(),
+                                                    app_.getCommandPool(),
+                                                    NesSoftwareRenderer::WIDTH,
+                                                    SCANLINES,
+                                                    VK_FORMAT_R8G8B8A8_UNORM,
+                                                    VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+    session->sink = sink;
+    if (sink) {
+        Buffer<uint8_t>::create(session->readback,
+                                NesSoftwareRenderer::WIDTH * SCANLINES * NesSoftwareRenderer::BYTES_PER_PIXEL,
+                                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                device_,
+                                app_.getPhysicalDevice());
+    }
+
+    MemoryUpdateComposer composer(session->ppuBuffer,
+                                  session->oam->getBuffer(),
+                                  session->control->getBuffer(),
+                                  offsetof(nes::Control, yOffset));
+    if (ppuAddressMap) {
+        composer.setPpuAddressMap(*ppuAddressMap);
+    }
+    auto clockUpdates = composeUpdates(composer);
+    session->stagingBuffer = composer.produceStagingBuffer(app_);
+    session->clock = std::make_unique<GameClock>(*session->stagingBuffer, composer.getStagingSize());
+    for (auto& clockUpdate : clockUpdates) {
+        session->clock->addUpdator(std::move(clockUpdate));
+    }
+
+    // Every scanline is rendered, in batches that never cross an update
+    auto schedule = composer.getDeviceSchedule();
+    std::vector<uint> batchStarts{0};
+    for (const auto& [scanline, copies] : schedule) {
+        if (scanline > 0 && scanline < SCANLINES) {
+            batchStarts.push_back(scanline);
+        }
+    }
+    for (size_t i = 0; i < batchStarts.size(); ++i) {
+        uint batchEnd = i + 1 < batchStarts.size() ? batchStarts[i + 1] : SCANLINES;
+        Batch batch{batchStarts[i], batchEnd - batchStarts[i], {}};
+        auto updates = schedule.find(batchStarts[i]);
+        if (updates != schedule.end()) {
+            for (const auto& copy : updates->second) {
+                batch.copies[copy.bufferIndex].push_back(copy.region);
+            }
+        }
+        session->batches.push_back(std::move(batch));
+    }
+    for (auto itr = schedule.lower_bound(SCANLINES); itr != schedule.end(); ++itr) {
+        for (const auto& copy : itr->second) {
+            session->lateCopies[copy.bufferIndex].push_back(copy.region);
+        }
+    }
+
+    VkDescriptorSetAllocateInfo setInfo{};
+    setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    setInfo.descriptorPool = descriptorPool_;
+    setInfo.descriptorSetCount = 1;
+    setInfo.pSetLayouts = &descriptorSetLayout_;
+    VK_SUCCESS_OR_THROW(vkAllocateDescriptorSets(device_, &setInfo, &session->descriptorSet),
+                        "Failed to allocate session descriptor set");
+
+    std::array<VkDescriptorBufferInfo, 3> bufferInfos{
+        VkDescriptorBufferInfo{session->ppuBuffer,
+                               0,
+                               compactMemory_ ? sizeof(nes::PackedPPUMemory) : sizeof(nes::PPUMemory)},
+        VkDescriptorBufferInfo{session->oam->getBuffer(), 0, sizeof(nes::OAM)},
+        VkDescriptorBufferInfo{session->control->getBuffer(), 0, sizeof(nes::Control)}};
+    VkDescriptorImageInfo imageInfo{VK_NULL_HANDLE, session->frame->getImageView(), VK_IMAGE_LAYOUT_GENERAL};
+    std::array<VkWriteDescriptorSet, 4> writes{};
+    for (uint32_t i = 0; i < writes.size(); ++i) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = session->descriptorSet;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        if (i < 3) {
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            writes[i].pBufferInfo = &bufferInfos[i];
+        } else {
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            writes[i].pImageInfo = &imageInfo;
+        }
+    }
+    vkUpdateDescriptorSets(device_, writes.size(), writes.data(), 0, nullptr);
+
+    sessions_.push_back(std::move(session));
+    return sessions_.back()->id;
+}
+
+void PpuSessionHost::removeSession(SessionId id) {
+    // The last submission may still be using the session's buffers
+    flush();
+    auto itr = std::find_if(sessions_.begin(), sessions_.end(), [id](const auto& session) {
+        return session->id == id;
+    });
+    if (itr == sessions_.end()) {
+        return;
+    }
+    vkFreeDescriptorSets(device_, descriptorPool_, 1, &(*itr)->descriptorSet);
+    sessions_.erase(itr);
+}
+
+void PpuSessionHost::flush() {
+    if (!inFlight_) {
+        return;
+    }
+    VK_SUCCESS_OR_THROW(vkWaitForFences(device_, 1, &submitFence_, VK_TRUE, UINT64_MAX),
+                        "Failed to wait for session host submission");
+    inFlight_ = false;
+
+    std::vector<uint8_t> rgba(NesSoftwareRenderer::WIDTH * SCANLINES * NesSoftwareRenderer::BYTES_PER_PIXEL);
+    for (auto& session : sessions_) {
+        if (!session->submitted || !session->sink) {
+            continue;
+        }
+        session->submitted = false;
+        session->readback->mapAndExecute(0, rgba.size(), [&rgba](void* mappedData) {
+            memcpy(rgba.data(), mappedData, rgba.size());
+        });
+        session->sink(session->submittedFrame, rgba);
+    }
+}
+
+void PpuSessionHost::tick() {
+    // Staging memory can't change while the previous copies may be reading it
+    flush();
+    if (sessions_.empty()) {
+        return;
+    }
+
+    threadPool_.parallelFor(sessions_.size(), [this](size_t i) {
+        auto& session = *sessions_[i];
+        if (session.started) {
+            session.clock->step();
+        }
+        session.started = true;
+    });
+
+    VK_SUCCESS_OR_THROW(vkResetCommandBuffer(commandBuffer_, 0),
+                        "Failed to reset session host command buffer");
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_SUCCESS_OR_THROW(vkBeginCommandBuffer(commandBuffer_, &beginInfo),
+                        "Failed to begin session host command buffer");
+    record(commandBuffer_);
+    VK_SUCCESS_OR_THROW(vkEndCommandBuffer(commandBuffer_),
+                        "Failed to end session host command buffer");
+
+    VK_SUCCESS_OR_THROW(vkResetFences(device_, 1, &submitFence_),
+                        "Failed to reset session host fence");
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer_;
+    VK_SUCCESS_OR_THROW(vkQueueSubmit(app_.getGraphicsQueue(), 1, &submitInfo, submitFence_),
+                        "Failed to submit session host command buffer");
+    inFlight_ = true;
+
+    for (auto& session : sessions_) {
+        session->submitted = true;
+        session->submittedFrame = session->clock->getCurrentFrame();
+    }
+}
+
+void PpuSessionHost::record(VkCommandBuffer commandBuffer) {
+    size_t phaseCount = 0;
+    for (const auto& session : sessions_) {
+        phaseCount = std::max(phaseCount, session->batches.size());
+    }
+
+    VkMemoryBarrier readBarrier{};
+    readBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    readBarrier.srcAccessMask = VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    readBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+    VkMemoryBarrier writeBarrier{};
+    writeBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    writeBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    writeBarrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+
+    // Phase n holds the n-th batch of every session
+    for (size_t phase = 0; phase < phaseCount; ++phase) {
+        // The previous phase's dispatches still read memory this phase writes
+        if (phase > 0) {
+            vkCmdPipelineBarrier(commandBuffer,
+                                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                 VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                 0, 1, &readBarrier, 0, nullptr, 0, nullptr);
+        }
+        for (auto& session : sessions_) {
+            if (phase >= session->batches.size()) {
+                continue;
+            }
+            const auto& batch = session->batches[phase];
+            recordCopies(commandBuffer, *session, batch.copies);
+            uint32_t yOffset = batch.firstScanline;
+            vkCmdUpdateBuffer(commandBuffer, session->control->getBuffer(), offsetof(nes::Control, yOffset), sizeof(yOffset), &yOffset);
+        }
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0, 1, &writeBarrier, 0, nullptr, 0, nullptr);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_);
+        for (auto& session : sessions_) {
+            if (phase >= session->batches.size()) {
+                continue;
+            }
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                                    pipelineLayout_,
+                                    0, 1,
+                                    &session->descriptorSet,
+                                    0, nullptr);
+            // One workgroup per scanline
+            vkCmdDispatch(commandBuffer, 1, session->batches[phase].scanlineCount, 1);
+        }
+    }
+
+    // Late updates & readbacks both wait on the last dispatches
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 1, &readBarrier, 0, nullptr, 0, nullptr);
+    for (auto& session : sessions_) {
+        recordCopies(commandBuffer, *session, session->lateCopies);
+        if (!session->sink) {
+            continue;
+        }
+        VkBufferImageCopy region{};
+        region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        region.imageExtent = {NesSoftwareRenderer::WIDTH, SCANLINES, 1};
+        vkCmdCopyImageToBuffer(commandBuffer,
+                               session->frame->getImage(),
+                               VK_IMAGE_LAYOUT_GENERAL,
+                               session->readback->getBuffer(),
+                               1, &region);
+    }
+
+    VkMemoryBarrier hostBarrier{};
+    hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT,
+                         0, 1, &hostBarrier, 0, nullptr, 0, nullptr);
+}
+
+void PpuSessionHost::recordCopies(VkCommandBuffer commandBuffer,
+                                  HostedSession& session,
+                                  const std::array<std::vector<VkBufferCopy>, 3>& copies) {
+    std::array<VkBuffer, 3> destinations{session.ppuBuffer,
+                                         session.oam->getBuffer(),
+                                         session.control->getBuffer()};
+    for (size_t bufferIndex = 0; bufferIndex < copies.size(); ++bufferIndex) {
+        if (copies[bufferIndex].empty()) {
+            continue;
+        }
+        vkCmdCopyBuffer(commandBuffer,
+                        session.stagingBuffer->getBuffer(),
+                        destinations[bufferIndex],
+                        copies[bufferIndex].size(),
+                        copies[bufferIndex].data());
+    }
+}
@@ -0,0 +1,121 @@
+#include "RenderClient.h"
+#include "PpuBatchRenderer.h"
+#include "ShmFeed.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <format>
+#include <stdexcept>
+
+RenderClient::RenderClient(const std::string& socketPath) {
+    fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd_ < 0) {
+        throw std::runtime_error("failed to create render client socket");
+    }
+    ignoreSigpipe(fd_);
+    sockaddr_un address = renderSocketAddress(socketPath);
+    if (connect(fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd_);
+        throw std::runtime_error(std::format("no render service at {}", socketPath));
+    }
+
+    if (!receiveAll(fd_, &hello_, sizeof(hello_))
+        || hello_.magic != RenderServiceHello::MAGIC
+        || hello_.version != RenderServiceHello::VERSION
+        || hello_.frameSize != PpuBatchRenderer::FRAME_SIZE) {
+        close(fd_);
+        throw std::runtime_error(std::format("{} is not a version {} render service", socketPath, RenderServiceHello::VERSION));
+    }
+    hello_.shmName[sizeof(hello_.shmName) - 1] = '\0';
+
+    framesSize_ = size_t(hello_.slotCount) * hello_.frameSize;
+    int shmFd = shm_open(hello_.shmName, O_RDONLY, 0600);
+    void* mapping = shmFd >= 0 ? mmap(nullptr, framesSize_, PROT_READ, MAP_SHARED, shmFd, 0) : MAP_FAILED;
+    if (shmFd >= 0) {
+        close(shmFd);
+    }
+    if (mapping == MAP_FAILED) {
+        close(fd_);
+        throw std::runtime_error(std::format("failed to map render service frames {}", hello_.shmName));
+    }
+    frames_ = static_cast<const uint8_t*>(mapping);
+    // The name is only needed to map it, this way nothing leaks if either end dies
+    shm_unlink(hello_.shmName);
+}
+
+RenderClient::~RenderClient() {
+    munmap(const_cast<uint8_t*>(frames_), framesSize_);
+    close(fd_);
+}
+
+const uint8_t* RenderClient::render(const NesMemoryState& state) {
+    RenderRequestHeader header{RenderServiceHello::MAGIC, RENDER_FULL_STATE, nextRequestId_++, sizeof(NesMemoryState), 0};
+    std::vector<uint8_t> delta;
+    if (lastState_ != nullptr) {
+        delta = buildDelta(state);
+        // A delta covering most of the state costs more than the state itself
+        if (!delta.empty() && delta.size() < sizeof(NesMemoryState)) {
+            header.kind = RENDER_DELTA;
+            header.payloadSize = delta.size();
+        }
+    }
+
+    const void* payload = header.kind == RENDER_DELTA ? static_cast<const void*>(delta.data()) : &state;
+    if (!sendAll(fd_, &header, sizeof(header)) || !sendAll(fd_, payload, header.payloadSize)) {
+        throw std::runtime_error("lost connection to render service");
+    }
+
+    RenderResponse response;
+    if (!receiveAll(fd_, &response, sizeof(response)) || response.requestId != header.requestId) {
+        throw std::runtime_error("lost connection to render service");
+    }
+    if (response.status != RENDER_OK || response.slot >= hello_.slotCount) {
+        throw std::runtime_error(std::format("render service rejected request with status {}", static_cast<int>(response.status)));
+    }
+
+    if (lastState_ == nullptr) {
+        lastState_ = std::make_unique<NesMemoryState>();
+    }
+    *lastState_ = state;
+    return frames_ + size_t(response.slot) * hello_.frameSize;
+}
+
+std::vector<uint8_t> RenderClient::buildDelta(const NesMemoryState& state) const {
+    // Changed bytes closer together than a record header are sent as one range
+    const size_t mergeDistance = sizeof(FeedRecord);
+
+    std::vector<uint8_t> message(sizeof(FeedFrameHeader) + 2 * sizeof(NesMemoryState));
+    FeedFrameWriter writer(message.data(), message.size(), nextRequestId_);
+    for (auto bufferIndex : {BufferIndex::PPU, BufferIndex::OAM, BufferIndex::CONTROL}) {
+        static const size_t bufferSizes[] = {sizeof(nes::PPUMemory), sizeof(nes::OAM), sizeof(nes::Control)};
+        const uint8_t* before = lastState_->bytes(bufferIndex);
+        const uint8_t* after = state.bytes(bufferIndex);
+        size_t size = bufferSizes[bufferIndex];
+
+        size_t i = 0;
+        while (i < size) {
+            if (before[i] == after[i]) {
+                ++i;
+                continue;
+            }
+            size_t start = i;
+            size_t end = i + 1;
+            for (size_t j = end; j < size && j < end + mergeDistance; ++j) {
+                if (before[j] != after[j]) {
+                    end = j + 1;
+                }
+            }
+            if (!writer.addDelta(static_cast<FeedBuffer>(bufferIndex), start, after + start, end - start)) {
+                return {};
+            }
+            i = end;
+        }
+    }
+
+    const auto* header = reinterpret_cast<const FeedFrameHeader*>(message.data());
+    message.resize(sizeof(FeedFrameHeader) + header->payloadSize);
+    return message;
+}
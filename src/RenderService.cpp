@@ -0,0 +1,284 @@
+#include "RenderService.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+namespace {
+    // Largest request payload read, a delta touching everything is a little over a full state
+    const size_t MAX_PAYLOAD = 2 * sizeof(NesMemoryState);
+}
+
+RenderService::RenderService(VulkanApp<F>& app,
+                             const std::vector<char>& computeShaderCode,
+                             RenderServiceConfig config)
+: config_(config),
+  renderer_(app, computeShaderCode, config.maxBatch) {
+    if (config_.slotsPerConnection == 0) {
+        throw std::runtime_error("render service needs at least one frame slot per connection");
+    }
+
+    listenFd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd_ < 0) {
+        throw std::runtime_error("failed to create render service socket");
+    }
+    // A stale socket file is left behind if a previous service was killed
+    unlink(config_.socketPath.c_str());
+    sockaddr_un address = renderSocketAddress(config_.socketPath);
+    if (bind(listenFd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+        || listen(listenFd_, SOMAXCONN) != 0) {
+        close(listenFd_);
+        throw std::runtime_error(std::format("failed to listen on {}", config_.socketPath));
+    }
+}
+
+RenderService::~RenderService() {
+    for (auto& connection : connections_) {
+        closeConnection(*connection);
+    }
+    close(listenFd_);
+    unlink(config_.socketPath.c_str());
+}
+
+void RenderService::run() {
+    std::vector<pollfd> pollFds;
+    while (!stopping_) {
+        pollFds.clear();
+        pollFds.push_back(pollfd{listenFd_, POLLIN, 0});
+        for (const auto& connection : connections_) {
+            // Connections with a full set of slots wait until their frames are answered
+            short events = connection->inFlight < config_.slotsPerConnection ? POLLIN : 0;
+            pollFds.push_back(pollfd{connection->fd, events, 0});
+        }
+
+        // Wake up regularly to notice stop requests
+        int timeoutMillis = 100;
+        if (!pending_.empty()) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(batchDeadline_ - std::chrono::steady_clock::now());
+            timeoutMillis = std::max<int>(0, remaining.count());
+        }
+        if (poll(pollFds.data(), pollFds.size(), timeoutMillis) < 0 && errno != EINTR) {
+            throw std::runtime_error("render service failed to poll");
+        }
+
+        bool hadPending = !pending_.empty();
+        for (size_t i = 1; i < pollFds.size(); ++i) {
+            auto& connection = connections_[i - 1];
+            if (pollFds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                closeConnection(*connection);
+            } else if (pollFds[i].revents & POLLIN) {
+                if (!receive(*connection) || !parseRequests(connection)) {
+                    closeConnection(*connection);
+                }
+            }
+        }
+        if (pollFds[0].revents & POLLIN) {
+            acceptConnection();
+        }
+        std::erase_if(connections_, [](const auto& connection) {
+            return connection->closed;
+        });
+
+        // The window starts with the first request of a batch
+        if (!hadPending && !pending_.empty()) {
+            batchDeadline_ = std::chrono::steady_clock::now() + std::chrono::microseconds(config_.batchWindowMicros);
+        }
+        if (!pending_.empty()
+            && (pending_.size() >= renderer_.getMaxBatch() || std::chrono::steady_clock::now() >= batchDeadline_)) {
+            renderPending();
+        }
+    }
+}
+
+void RenderService::acceptConnection() {
+    int fd = accept(listenFd_, nullptr, nullptr);
+    if (fd < 0) {
+        return;
+    }
+    ignoreSigpipe(fd);
+
+    auto connection = std::make_shared<Connection>();
+    connection->fd = fd;
+    connection->shmName = std::format("/ppu-render-{}-{}", getpid(), connectionsAccepted_++);
+    connection->framesSize = config_.slotsPerConnection * PpuBatchRenderer::FRAME_SIZE;
+    connection->frames = nullptr;
+
+    int shmFd = shm_open(connection->shmName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (shmFd >= 0) {
+        if (ftruncate(shmFd, connection->framesSize) == 0) {
+            void* mapping = mmap(nullptr, connection->framesSize, PROT_READ | PROT_WRITE, MAP_SHARED, shmFd, 0);
+            if (mapping != MAP_FAILED) {
+                connection->frames = static_cast<uint8_t*>(mapping);
+            }
+        }
+        close(shmFd);
+    }
+
+    RenderServiceHello hello{RenderServiceHello::MAGIC,
+                             RenderServiceHello::VERSION,
+                             config_.slotsPerConnection,
+                             static_cast<uint32_t>(PpuBatchRenderer::FRAME_SIZE),
+                             {}};
+    strncpy(hello.shmName, connection->shmName.c_str(), sizeof(hello.shmName) - 1);
+    if (connection->frames == nullptr || !sendAll(fd, &hello, sizeof(hello))) {
+        closeConnection(*connection);
+        return;
+    }
+    connections_.push_back(connection);
+}
+
+void RenderService::closeConnection(Connection& connection) {
+    if (connection.closed) {
+        return;
+    }
+    connection.closed = true;
+    close(connection.fd);
+    if (connection.frames != nullptr) {
+        munmap(connection.frames, connection.framesSize);
+    }
+    // The client may already have unlinked it once mapped
+    shm_unlink(connection.shmName.c_str());
+}
+
+bool RenderService::receive(Connection& connection) {
+    uint8_t buffer[64 * 1024];
+    ssize_t received = recv(connection.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (received == 0) {
+        return false;
+    }
+    if (received < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    connection.inbox.insert(connection.inbox.end(), buffer, buffer + received);
+    return true;
+}
+
+bool RenderService::parseRequests(const std::shared_ptr<Connection>& connection) {
+    size_t parsed = 0;
+    auto& inbox = connection->inbox;
+    while (connection->inFlight < config_.slotsPerConnection
+           && inbox.size() - parsed >= sizeof(RenderRequestHeader)) {
+        RenderRequestHeader header;
+        memcpy(&header, inbox.data() + parsed, sizeof(header));
+        if (header.magic != RenderServiceHello::MAGIC || header.payloadSize > MAX_PAYLOAD) {
+            return false;
+        }
+        if (inbox.size() - parsed < sizeof(header) + header.payloadSize) {
+            break;
+        }
+
+        PendingRequest request{connection,
+                               header.requestId,
+                               applyRequest(*connection, header, inbox.data() + parsed + sizeof(header)),
+                               static_cast<uint32_t>(connection->requestsParsed % config_.slotsPerConnection),
+                               nullptr};
+        if (request.status == RENDER_OK) {
+            // Later deltas in the same batch must not change this frame
+            request.state = std::make_unique<NesMemoryState>(*connection->state);
+        }
+        pending_.push_back(std::move(request));
+        connection->requestsParsed += 1;
+        connection->inFlight += 1;
+        parsed += sizeof(header) + header.payloadSize;
+    }
+    inbox.erase(inbox.begin(), inbox.begin() + parsed);
+    return true;
+}
+
+RenderStatus RenderService::applyRequest(Connection& connection,
+                                         const RenderRequestHeader& header,
+                                         const uint8_t* payload) {
+    if (header.kind == RENDER_FULL_STATE) {
+        if (header.payloadSize != sizeof(NesMemoryState)) {
+            return RENDER_BAD_REQUEST;
+        }
+        if (connection.state == nullptr) {
+            connection.state = std::make_unique<NesMemoryState>();
+        }
+        memcpy(connection.state.get(), payload, sizeof(NesMemoryState));
+        return RENDER_OK;
+    }
+
+    if (header.kind != RENDER_DELTA) {
+        return RENDER_BAD_REQUEST;
+    }
+    if (connection.state == nullptr) {
+        return RENDER_NO_BASE_STATE;
+    }
+    if (header.payloadSize < sizeof(FeedFrameHeader)) {
+        return RENDER_BAD_REQUEST;
+    }
+
+    // Applied to a copy so a bad delta leaves the base state alone
+    NesMemoryState state = *connection.state;
+    static const size_t bufferSizes[] = {sizeof(nes::PPUMemory), sizeof(nes::OAM), sizeof(nes::Control)};
+    try {
+        FeedFrameReader reader(payload, header.payloadSize);
+        FeedRecord record;
+        const uint8_t* data;
+        while (reader.next(record, data)) {
+            if (record.kind != FEED_DELTA
+                || record.buffer > FEED_CONTROL
+                || record.size > bufferSizes[record.buffer]
+                || record.offset > bufferSizes[record.buffer] - record.size) {
+                return RENDER_BAD_REQUEST;
+            }
+            memcpy(state.bytes(static_cast<BufferIndex>(record.buffer)) + record.offset, data, record.size);
+        }
+    } catch (const std::runtime_error&) {
+        return RENDER_BAD_REQUEST;
+    }
+    *connection.state = state;
+    return RENDER_OK;
+}
+
+void RenderService::renderPending() {
+    size_t batchSize = std::min<size_t>(pending_.size(), renderer_.getMaxBatch());
+
+    std::vector<const NesMemoryState*> states;
+    std::vector<uint8_t*> frames;
+    for (size_t i = 0; i < batchSize; ++i) {
+        const auto& request = pending_[i];
+        if (request.status == RENDER_OK && !request.connection->closed) {
+            states.push_back(request.state.get());
+            frames.push_back(request.connection->frames + request.slot * PpuBatchRenderer::FRAME_SIZE);
+        }
+    }
+    renderer_.render(states, frames);
+
+    // Answered in the order they were parsed, which is each connection's request order
+    for (size_t i = 0; i < batchSize; ++i) {
+        auto request = std::move(pending_.front());
+        pending_.pop_front();
+        auto& connection = *request.connection;
+        if (connection.closed) {
+            continue;
+        }
+        connection.inFlight -= 1;
+        RenderResponse response{request.requestId, request.status, request.slot};
+        if (!sendAll(connection.fd, &response, sizeof(response))) {
+            closeConnection(connection);
+        }
+    }
+
+    // Requests held back while their connection had no free slots
+    for (auto& connection : connections_) {
+        if (!connection->closed && !parseRequests(connection)) {
+            closeConnection(*connection);
+        }
+    }
+    std::erase_if(connections_, [](const auto& connection) {
+        return connection->closed;
+    });
+    if (!pending_.empty()) {
+        batchDeadline_ = std::chrono::steady_clock::now() + std::chrono::microseconds(config_.batchWindowMicros);
+    }
+}
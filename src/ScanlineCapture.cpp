@@ -0,0 +1,452 @@
+#include "ScanlineCapture.h"
+#include "SessionSnapshot.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+    enum RecordType : uint8_t {
+        END_RECORD = 0,
+        KEYFRAME_RECORD = 1,
+        DELTA_RECORD = 2
+    };
+
+    enum RowCoding : uint8_t {
+        RAW_ROWS = 0,
+        RANS_ROWS = 1
+    };
+
+    uint64_t hashRow(const uint8_t* row, uint width) {
+        // FNV-1a
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (uint x = 0; x < width; ++x) {
+            hash = (hash ^ row[x]) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    // Byte-wise rANS with a static order-0 model per frame
+    namespace rans {
+        const uint32_t SCALE_BITS = 12;
+        const uint32_t TOTAL = 1u << SCALE_BITS;
+        // Lower bound of the normalized state
+        const uint32_t LOWER = 1u << 23;
+
+        // Scales symbol counts to TOTAL, keeping every symbol that occurs
+        std::array<uint16_t, 256> normalize(const std::array<uint32_t, 256>& counts, size_t symbolTotal) {
+            std::array<uint16_t, 256> freqs{};
+            uint32_t sum = 0;
+            for (uint s = 0; s < 256; ++s) {
+                if (counts[s] > 0) {
+                    freqs[s] = std::max<uint32_t>(1, uint64_t(counts[s]) * TOTAL / symbolTotal);
+                    sum += freqs[s];
+                }
+            }
+            // Rounding is settled on the most frequent symbols, which can afford it
+            while (sum != TOTAL) {
+                uint largest = std::max_element(freqs.begin(), freqs.end()) - freqs.begin();
+                if (sum < TOTAL) {
+                    freqs[largest] += TOTAL - sum;
+                    sum = TOTAL;
+                } else {
+                    uint32_t take = std::min<uint32_t>(sum - TOTAL, freqs[largest] - 1);
+                    if (take == 0) {
+                        throw std::runtime_error("rANS frequencies can't be normalized");
+                    }
+                    freqs[largest] -= take;
+                    sum -= take;
+                }
+            }
+            return freqs;
+        }
+
+        void encode(const std::vector<uint8_t>& symbols, StateWriter& writer) {
+            std::array<uint32_t, 256> counts{};
+            for (uint8_t symbol : symbols) {
+                counts[symbol] += 1;
+            }
+            auto freqs = normalize(counts, symbols.size());
+            std::array<uint32_t, 256> starts{};
+            uint16_t symbolCount = 0;
+            for (uint s = 0, start = 0; s < 256; start += freqs[s], ++s) {
+                starts[s] = start;
+                symbolCount += freqs[s] > 0;
+            }
+
+            // Encoded back to front so the decoder reads forwards; each symbol emits at most 2 bytes
+            std::vector<uint8_t> coded(2 * symbols.size() + 4);
+            uint8_t* out = coded.data() + coded.size();
+            uint32_t state = LOWER;
+            for (size_t i = symbols.size(); i-- > 0;) {
+                uint32_t freq = freqs[symbols[i]];
+                uint32_t maxState = ((LOWER >> SCALE_BITS) << 8) * freq;
+                while (state >= maxState) {
+                    *--out = static_cast<uint8_t>(state);
+                    state >>= 8;
+                }
+                state = ((state / freq) << SCALE_BITS) + (state % freq) + starts[symbols[i]];
+            }
+            out -= 4;
+            memcpy(out, &state, sizeof(state));
+
+            writer.write(symbolCount);
+            for (uint s = 0; s < 256; ++s) {
+                if (freqs[s] > 0) {
+                    writer.write(static_cast<uint8_t>(s));
+                    writer.write(freqs[s]);
+                }
+            }
+            writer.writeBytes(out, coded.data() + coded.size() - out);
+        }
+
+        void decode(const uint8_t* data, size_t size, uint8_t* symbols, size_t symbolCount) {
+            const uint8_t* end = data + size;
+            auto need = [&](size_t bytes) {
+                if (static_cast<size_t>(end - data) < bytes) {
+                    throw std::runtime_error("scanline capture rows are truncated");
+                }
+            };
+
+            need(sizeof(uint16_t));
+            uint16_t usedSymbols;
+            memcpy(&usedSymbols, data, sizeof(usedSymbols));
+            data += sizeof(usedSymbols);
+
+            std::array<uint16_t, 256> freqs{};
+            std::array<uint32_t, 256> starts{};
+            std::array<uint8_t, TOTAL> slots;
+            uint32_t start = 0;
+            for (uint i = 0; i < usedSymbols; ++i) {
+                need(3);
+                uint8_t symbol = data[0];
+                uint16_t freq;
+                memcpy(&freq, data + 1, sizeof(freq));
+                data += 3;
+                if (freq == 0 || start + freq > TOTAL) {
+                    throw std::runtime_error("scanline capture has a bad frequency table");
+                }
+                freqs[symbol] = freq;
+                starts[symbol] = start;
+                std::fill(slots.begin() + start, slots.begin() + start + freq, symbol);
+                start += freq;
+            }
+            if (start != TOTAL) {
+                throw std::runtime_error("scanline capture has a bad frequency table");
+            }
+
+            need(sizeof(uint32_t));
+            uint32_t state;
+            memcpy(&state, data, sizeof(state));
+            data += sizeof(state);
+            for (size_t i = 0; i < symbolCount; ++i) {
+                uint8_t symbol = slots[state & (TOTAL - 1)];
+                symbols[i] = symbol;
+                state = freqs[symbol] * (state >> SCALE_BITS) + (state & (TOTAL - 1)) - starts[symbol];
+                while (state < LOWER) {
+                    need(1);
+                    state = (state << 8) | *data++;
+                }
+            }
+        }
+    }
+}
+
+ScanlineCaptureWriter::ScanlineCaptureWriter(std::ostream& stream, uint width, uint height, uint keyframeInterval)
+: stream_(stream) {
+    if (width == 0 || height == 0) {
+        throw std::runtime_error("scanline capture needs a frame size");
+    }
+    header_.width = width;
+    header_.height = height;
+    header_.keyframeInterval = keyframeInterval;
+    previous_.resize(width * height);
+    current_.resize(width * height);
+    write(&header_, sizeof(header_));
+}
+
+ScanlineCaptureWriter::~ScanlineCaptureWriter() {
+    try {
+        finish();
+    } catch (...) {
+        // Nothing left to report the failure to
+    }
+}
+
+void ScanlineCaptureWriter::writeFrame(const uint8_t* rgba) {
+    if (finished_) {
+        throw std::runtime_error("scanline capture is already finished");
+    }
+    const uint width = header_.width;
+    const uint height = header_.height;
+    bool keyframe = frameCount_ == 0
+        || (header_.keyframeInterval > 0 && frameCount_ % header_.keyframeInterval == 0);
+
+    // Colors get the next index the first time they're seen
+    size_t paletteStart = palette_.size();
+    for (size_t i = 0; i < current_.size(); ++i) {
+        uint32_t color;
+        memcpy(&color, rgba + 4 * i, sizeof(color));
+        auto found = paletteIndices_.find(color);
+        if (found == paletteIndices_.end()) {
+            if (palette_.size() == 256) {
+                throw std::runtime_error("scanline capture frames can use at most 256 colors");
+            }
+            found = paletteIndices_.emplace(color, static_cast<uint8_t>(palette_.size())).first;
+            palette_.push_back(color);
+        }
+        current_[i] = found->second;
+    }
+
+    StateWriter body;
+    // Keyframes carry the whole palette, other frames only what it gained
+    size_t firstColor = keyframe ? 0 : paletteStart;
+    body.write(static_cast<uint16_t>(palette_.size() - firstColor));
+    body.writeBytes(palette_.data() + firstColor, (palette_.size() - firstColor) * sizeof(uint32_t));
+
+    std::vector<uint8_t> changedMask((height + 7) / 8, 0);
+    std::vector<uint8_t> rows;
+    std::vector<uint64_t> hashes;
+    for (uint y = 0; y < height; ++y) {
+        const uint8_t* row = current_.data() + y * width;
+        if (!keyframe && memcmp(row, previous_.data() + y * width, width) == 0) {
+            continue;
+        }
+        changedMask[y / 8] |= 1 << (y % 8);
+        rows.insert(rows.end(), row, row + width);
+        hashes.push_back(hashRow(row, width));
+    }
+    body.writeBytes(changedMask.data(), changedMask.size());
+    body.writeBytes(hashes.data(), hashes.size() * sizeof(uint64_t));
+
+    // Rows are only entropy coded when that comes out smaller
+    StateWriter coded;
+    if (!rows.empty()) {
+        rans::encode(rows, coded);
+    }
+    if (!rows.empty() && coded.getData().size() < rows.size()) {
+        body.write(RANS_ROWS);
+        body.writeBytes(coded.getData().data(), coded.getData().size());
+    } else {
+        body.write(RAW_ROWS);
+        body.writeBytes(rows.data(), rows.size());
+    }
+
+    if (keyframe) {
+        keyframes_.emplace_back(frameCount_, bytesWritten_);
+    }
+    uint8_t type = keyframe ? KEYFRAME_RECORD : DELTA_RECORD;
+    uint32_t bodySize = body.getData().size();
+    write(&type, sizeof(type));
+    write(&bodySize, sizeof(bodySize));
+    write(body.getData().data(), bodySize);
+
+    std::swap(previous_, current_);
+    frameCount_ += 1;
+}
+
+void ScanlineCaptureWriter::finish() {
+    if (finished_) {
+        return;
+    }
+    finished_ = true;
+
+    uint8_t type = END_RECORD;
+    uint32_t bodySize = 0;
+    write(&type, sizeof(type));
+    write(&bodySize, sizeof(bodySize));
+
+    uint64_t footerOffset = bytesWritten_;
+    StateWriter footer;
+    footer.write<uint64_t>(keyframes_.size());
+    for (const auto& [frame, offset] : keyframes_) {
+        footer.write(frame);
+        footer.write(offset);
+    }
+    footer.write(footerOffset);
+    footer.write(ScanlineCaptureHeader::FOOTER_MAGIC);
+    write(footer.getData().data(), footer.getData().size());
+    stream_.flush();
+}
+
+void ScanlineCaptureWriter::write(const void* data, size_t size) {
+    stream_.write(static_cast<const char*>(data), size);
+    if (!stream_) {
+        throw std::runtime_error("Failed to write scanline capture");
+    }
+    bytesWritten_ += size;
+}
+
+ScanlineCaptureReader::ScanlineCaptureReader(std::istream& stream)
+: stream_(stream) {
+    if (!stream_.read(reinterpret_cast<char*>(&header_), sizeof(header_))
+        || header_.magic != ScanlineCaptureHeader::MAGIC) {
+        throw std::runtime_error("not a scanline capture");
+    }
+    if (header_.version != ScanlineCaptureHeader::VERSION) {
+        throw std::runtime_error("unsupported scanline capture version");
+    }
+    if (header_.width == 0 || header_.height == 0) {
+        throw std::runtime_error("scanline capture has no frame size");
+    }
+    indices_.resize(header_.width * header_.height);
+    hashes_.resize(header_.height);
+    changed_.resize(header_.height);
+
+    // Pipes can still be read front to back without the index
+    auto start = stream_.tellg();
+    if (start != std::istream::pos_type(-1)) {
+        readIndex();
+        stream_.clear();
+        stream_.seekg(start);
+    }
+}
+
+void ScanlineCaptureReader::readIndex() {
+    const size_t trailerSize = sizeof(uint64_t) + sizeof(uint32_t);
+    if (!stream_.seekg(-static_cast<std::streamoff>(trailerSize), std::ios::end)) {
+        return;
+    }
+    uint64_t fileSize = static_cast<uint64_t>(stream_.tellg()) + trailerSize;
+    uint64_t footerOffset;
+    uint32_t footerMagic;
+    stream_.read(reinterpret_cast<char*>(&footerOffset), sizeof(footerOffset));
+    stream_.read(reinterpret_cast<char*>(&footerMagic), sizeof(footerMagic));
+    if (!stream_ || footerMagic != ScanlineCaptureHeader::FOOTER_MAGIC) {
+        // Unfinished capture, its frames can still be read in order
+        return;
+    }
+
+    // The index must fill the file exactly between its offset & the trailer
+    const uint64_t entrySize = 2 * sizeof(uint64_t);
+    uint64_t keyframeCount = 0;
+    if (footerOffset > fileSize - trailerSize - sizeof(keyframeCount)) {
+        throw std::runtime_error("scanline capture index is out of bounds");
+    }
+    stream_.seekg(footerOffset);
+    stream_.read(reinterpret_cast<char*>(&keyframeCount), sizeof(keyframeCount));
+    uint64_t entriesSize = fileSize - trailerSize - sizeof(keyframeCount) - footerOffset;
+    if (!stream_ || entriesSize % entrySize != 0 || keyframeCount != entriesSize / entrySize) {
+        throw std::runtime_error("scanline capture index doesn't match the file size");
+    }
+    keyframes_.resize(keyframeCount);
+    for (auto& [frame, offset] : keyframes_) {
+        stream_.read(reinterpret_cast<char*>(&frame), sizeof(frame));
+        stream_.read(reinterpret_cast<char*>(&offset), sizeof(offset));
+    }
+    if (!stream_) {
+        throw std::runtime_error("scanline capture index is truncated");
+    }
+    indexed_ = true;
+}
+
+bool ScanlineCaptureReader::readFrame(std::vector<uint8_t>& rgba) {
+    if (ended_) {
+        return false;
+    }
+    uint8_t type;
+    uint32_t bodySize;
+    stream_.read(reinterpret_cast<char*>(&type), sizeof(type));
+    stream_.read(reinterpret_cast<char*>(&bodySize), sizeof(bodySize));
+    if (!stream_ || type == END_RECORD) {
+        // A capture that was never finished simply ends
+        ended_ = true;
+        return false;
+    }
+    if (type != KEYFRAME_RECORD && type != DELTA_RECORD) {
+        throw std::runtime_error("unknown scanline capture record");
+    }
+    record_.resize(bodySize);
+    if (!stream_.read(reinterpret_cast<char*>(record_.data()), bodySize)) {
+        throw std::runtime_error("scanline capture record is truncated");
+    }
+
+    const uint width = header_.width;
+    const uint height = header_.height;
+    StateReader body(record_);
+
+    uint16_t colorCount;
+    body.read(colorCount);
+    if (type == KEYFRAME_RECORD) {
+        palette_.clear();
+    } else if (nextFrame_ == 0) {
+        throw std::runtime_error("scanline capture doesn't start with a keyframe");
+    }
+    size_t firstColor = palette_.size();
+    palette_.resize(firstColor + colorCount);
+    body.readBytes(palette_.data() + firstColor, colorCount * sizeof(uint32_t));
+
+    std::vector<uint8_t> changedMask((height + 7) / 8);
+    body.readBytes(changedMask.data(), changedMask.size());
+    std::vector<uint> changedRows;
+    for (uint y = 0; y < height; ++y) {
+        changed_[y] = (changedMask[y / 8] >> (y % 8)) & 1;
+        if (changed_[y]) {
+            changedRows.push_back(y);
+        }
+    }
+    if (type == KEYFRAME_RECORD && changedRows.size() != height) {
+        throw std::runtime_error("scanline capture keyframe is missing scanlines");
+    }
+    std::vector<uint64_t> hashes(changedRows.size());
+    if (!hashes.empty()) {
+        body.readBytes(hashes.data(), hashes.size() * sizeof(uint64_t));
+    }
+
+    RowCoding coding;
+    body.read(coding);
+    std::vector<uint8_t> rows(changedRows.size() * width);
+    // Rows take up the rest of the record
+    size_t headerSize = sizeof(colorCount) + colorCount * sizeof(uint32_t) + changedMask.size()
+        + hashes.size() * sizeof(uint64_t) + sizeof(coding);
+    const uint8_t* payload = record_.data() + headerSize;
+    size_t payloadSize = record_.size() - headerSize;
+    if (coding == RANS_ROWS) {
+        rans::decode(payload, payloadSize, rows.data(), rows.size());
+    } else if (coding == RAW_ROWS && payloadSize == rows.size()) {
+        std::copy(payload, payload + payloadSize, rows.begin());
+    } else {
+        throw std::runtime_error("scanline capture rows are malformed");
+    }
+
+    for (size_t i = 0; i < changedRows.size(); ++i) {
+        const uint8_t* row = rows.data() + i * width;
+        if (hashRow(row, width) != hashes[i]) {
+            throw std::runtime_error("scanline capture row doesn't match its hash");
+        }
+        memcpy(indices_.data() + changedRows[i] * width, row, width);
+        hashes_[changedRows[i]] = hashes[i];
+    }
+
+    rgba.resize(indices_.size() * 4);
+    for (size_t i = 0; i < indices_.size(); ++i) {
+        if (indices_[i] >= palette_.size()) {
+            throw std::runtime_error("scanline capture pixel is outside the palette");
+        }
+        memcpy(rgba.data() + 4 * i, &palette_[indices_[i]], sizeof(uint32_t));
+    }
+    nextFrame_ += 1;
+    return true;
+}
+
+void ScanlineCaptureReader::seek(uint64_t frame) {
+    if (!indexed_) {
+        throw std::runtime_error("scanline capture has no index to seek with");
+    }
+    auto keyframe = std::upper_bound(keyframes_.begin(), keyframes_.end(), frame,
+                                     [](uint64_t target, const std::pair<uint64_t, uint64_t>& entry) {
+                                         return target < entry.first;
+                                     });
+    if (keyframe == keyframes_.begin()) {
+        throw std::runtime_error("scanline capture has no keyframe before the requested frame");
+    }
+    --keyframe;
+
+    stream_.clear();
+    stream_.seekg(keyframe->second);
+    nextFrame_ = keyframe->first;
+    ended_ = false;
+    std::vector<uint8_t> skipped;
+    while (nextFrame_ < frame && readFrame(skipped)) {}
+}
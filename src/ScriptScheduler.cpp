@@ -0,0 +1,163 @@
+#include "ScriptScheduler.h"
+
+#include <stdexcept>
+#include <string>
+
+void* ScriptArena::allocate(size_t size) {
+    size = roundUp(size);
+    auto freeList = freeLists_.find(size);
+    if (freeList != freeLists_.end() && freeList->second != nullptr) {
+        void* block = freeList->second;
+        freeList->second = *static_cast<void**>(block);
+        return block;
+    }
+
+    // Frames bigger than a chunk get one of their own, put behind the current chunk
+    if (size > chunkSize_) {
+        auto chunk = std::make_unique<std::byte[]>(size);
+        void* block = chunk.get();
+        chunks_.insert(chunks_.empty() ? chunks_.end() : chunks_.end() - 1, std::move(chunk));
+        return block;
+    }
+
+    if (chunks_.empty() || used_ + size > chunkSize_) {
+        chunks_.push_back(std::make_unique<std::byte[]>(chunkSize_));
+        used_ = 0;
+    }
+    void* block = chunks_.back().get() + used_;
+    used_ += size;
+    return block;
+}
+
+void ScriptArena::deallocate(void* ptr, size_t size) {
+    void*& head = freeLists_[roundUp(size)];
+    *static_cast<void**>(ptr) = head;
+    head = ptr;
+}
+
+void UpdateScript::promise_type::operator delete(void* ptr, size_t size) {
+    auto* block = static_cast<std::byte*>(ptr) - ScriptArena::ALIGNMENT;
+    (*reinterpret_cast<ScriptArena**>(block))->deallocate(block, size + ScriptArena::ALIGNMENT);
+}
+
+ScriptScheduler::ScriptScheduler()
+: GameClock::UpdateFunction(StagingRegionHandle{0, 0, 0, BufferIndex::PPU}) {}
+
+ScriptScheduler::~ScriptScheduler() {
+    destroyScripts();
+}
+
+void ScriptScheduler::addTarget(MemoryUpdateComposer& composer,
+                                BufferIndex dstBuffer,
+                                size_t dstOffset,
+                                size_t size,
+                                uint scanline,
+                                void* initialValue) {
+    auto field = composer.addStagingField(dstBuffer, dstOffset, size, initialValue);
+    composer.addUpdate(field, scanline);
+
+    // The span grows to cover every target, & whatever was added between them
+    if (targets_.empty()) {
+        handle_ = field;
+    }
+    size_t spanOffset = field.stagingDataOffset - handle_.stagingDataOffset;
+    handle_.size = std::max(handle_.size, spanOffset + size);
+    targets_.push_back(Target{dstBuffer, dstOffset, size, scanline, spanOffset});
+}
+
+void ScriptScheduler::start(ScriptFactory script) {
+    schedule(script(*this).release(), frame_ + 1, 0);
+    started_.push_back(StartedScript{frame_ + 1, std::move(script), resuming_});
+}
+
+uint8_t* ScriptScheduler::getTarget(BufferIndex dstBuffer, size_t dstOffset, size_t size) {
+    for (const auto& target : targets_) {
+        if (target.dstBuffer == dstBuffer
+            && target.scanline == scanline_
+            && dstOffset >= target.dstOffset
+            && dstOffset + size <= target.dstOffset + target.size) {
+            return span_ + target.spanOffset + (dstOffset - target.dstOffset);
+        }
+    }
+    throw std::runtime_error("script wrote to memory with no target at scanline " + std::to_string(scanline_));
+}
+
+void ScriptScheduler::execute(void* mappedData) {
+    if (due_.empty()) {
+        return;
+    }
+    span_ = static_cast<uint8_t*>(mappedData);
+    runUntil(due_.top().frame);
+}
+
+void ScriptScheduler::saveState(StateWriter& writer) const {
+    GameClock::UpdateFunction::saveState(writer);
+    writer.write(frame_);
+}
+
+void ScriptScheduler::loadState(StateReader& reader) {
+    GameClock::UpdateFunction::loadState(reader);
+    long savedFrame;
+    reader.read(savedFrame);
+
+    // Replay from the start, only waking scripts when they're due. Scripts
+    // started after the saved frame are left to wake when they were started.
+    destroyScripts();
+    frame_ = 0;
+    scanline_ = 0;
+    nextOrder_ = 0;
+    // Only scripts started from outside are kept, replay starts the rest again
+    std::vector<StartedScript> started = std::move(started_);
+    started_.clear();
+    for (auto& script : started) {
+        if (!script.byScript) {
+            schedule(script.factory(*this).release(), script.frame, 0);
+            started_.push_back(std::move(script));
+        }
+    }
+    std::vector<uint8_t> scratch(handle_.size);
+    span_ = scratch.data();
+    try {
+        while (!due_.empty() && due_.top().frame <= savedFrame) {
+            runUntil(due_.top().frame);
+        }
+    } catch (...) {
+        span_ = nullptr;
+        throw;
+    }
+    frame_ = savedFrame;
+    span_ = nullptr;
+}
+
+void ScriptScheduler::schedule(std::coroutine_handle<UpdateScript::promise_type> script, long frame, uint scanline) {
+    due_.push(Wake{frame, scanline, nextOrder_++, script});
+}
+
+void ScriptScheduler::runUntil(long frame) {
+    frame_ = frame;
+    while (!due_.empty() && due_.top().frame <= frame) {
+        Wake wake = due_.top();
+        due_.pop();
+        scanline_ = wake.scanline;
+        resuming_ = true;
+        wake.script.resume();
+        resuming_ = false;
+
+        // Scripts that didn't wait again have finished
+        if (wake.script.done()) {
+            auto exception = wake.script.promise().exception;
+            wake.script.destroy();
+            if (exception) {
+                std::rethrow_exception(exception);
+            }
+        }
+    }
+    scanline_ = 0;
+}
+
+void ScriptScheduler::destroyScripts() {
+    while (!due_.empty()) {
+        due_.top().script.destroy();
+        due_.pop();
+    }
+}
@@ -0,0 +1,43 @@
+#include "SessionSnapshot.h"
+
+#include <format>
+#include <fstream>
+
+void SessionSnapshot::writeToFile(const std::string& path) const {
+    StateWriter writer;
+    writer.write(MAGIC);
+    writer.write(VERSION);
+    writer.write(frame);
+    for (const auto* section : {&ppu, &oam, &control, &staging, &clockState}) {
+        writer.writeVector(*section);
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(writer.getData().data()), writer.getData().size());
+    if (!file) {
+        throw std::runtime_error(std::format("failed to write snapshot {}", path));
+    }
+}
+
+SessionSnapshot SessionSnapshot::readFromFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error(std::format("failed to open snapshot {}", path));
+    }
+    std::vector<uint8_t> data(std::istreambuf_iterator<char>(file), {});
+
+    StateReader reader(data);
+    uint32_t magic, version;
+    reader.read(magic);
+    reader.read(version);
+    if (magic != MAGIC || version != VERSION) {
+        throw std::runtime_error(std::format("{} is not a version {} snapshot", path, VERSION));
+    }
+
+    SessionSnapshot snapshot;
+    reader.read(snapshot.frame);
+    for (auto* section : {&snapshot.ppu, &snapshot.oam, &snapshot.control, &snapshot.staging, &snapshot.clockState}) {
+        reader.readVector(*section);
+    }
+    return snapshot;
+}
@@ -0,0 +1,200 @@
+#include "SessionTimeline.h"
+
+#include <VulkanApp.h>
+
+#include <utility>
+
+SessionTimeline::SessionTimeline(VulkanApp<F>& app,
+                                 GameClock& clock,
+                                 Buffer<uint8_t>& stagingBuffer,
+                                 size_t stagingSize,
+                                 std::array<SnapshotBuffer, 3> memoryBuffers,
+                                 std::array<std::vector<uint8_t>, 3> initialMemory,
+                                 uint keyframeInterval,
+                                 PpuProfiler* profiler)
+: app_(app),
+  clock_(clock),
+  stagingBuffer_(stagingBuffer),
+  stagingSize_(stagingSize),
+  memoryBuffers_(memoryBuffers),
+  keyframeInterval_(keyframeInterval),
+  profiler_(profiler) {
+    callback_ = std::make_shared<std::function<void(VulkanApp<F>&,uint32_t)>>(
+    [this](VulkanApp<F>&,uint32_t) {
+        this->onFrame();
+    });
+
+    for (size_t i = 0; i < memoryBuffers_.size(); ++i) {
+        Buffer<uint8_t>::create(readbackBuffers_[i],
+                                memoryBuffers_[i].size,
+                                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                app_.getDevice(),
+                                app_.getPhysicalDevice());
+        Buffer<uint8_t>::create(uploadBuffers_[i],
+                                memoryBuffers_[i].size,
+                                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                app_.getDevice(),
+                                app_.getPhysicalDevice());
+    }
+
+    // Nothing has been copied into the buffers yet, so they needn't be read back
+    SessionSnapshot initial = captureHostState();
+    initial.ppu = std::move(initialMemory[BufferIndex::PPU]);
+    initial.oam = std::move(initialMemory[BufferIndex::OAM]);
+    initial.control = std::move(initialMemory[BufferIndex::CONTROL]);
+    keyframes_.emplace(initial.frame, std::move(initial));
+}
+
+std::string SessionTimeline::takeSeekError() {
+    std::lock_guard<std::mutex> lock(seekErrorMutex_);
+    return std::exchange(seekError_, std::string());
+}
+
+void SessionTimeline::onFrame() {
+    // The last frame's fence has been waited on, so its copies are done
+    if (pendingCapture_ && captureRecorded_) {
+        finishCapture();
+    }
+
+    int64_t seekTarget = pendingSeek_.exchange(NO_SEEK);
+    if (seekTarget != NO_SEEK) {
+        try {
+            seek(seekTarget);
+        } catch (const std::runtime_error& error) {
+            // Throwing here would end the render loop
+            std::lock_guard<std::mutex> lock(seekErrorMutex_);
+            seekError_ = error.what();
+        }
+        return;
+    }
+
+    uint64_t frame = clock_.getCurrentFrame();
+    if (frame % keyframeInterval_ == 0 && keyframes_.find(frame) == keyframes_.end() && !pendingCapture_) {
+        PpuProfiler::Span span(profiler_, "SessionTimeline::capture");
+        pendingCapture_ = captureHostState();
+        captureRecorded_ = false;
+    }
+}
+
+void SessionTimeline::seek(uint64_t frame) {
+    PpuProfiler::Span span(profiler_, "SessionTimeline::seek");
+
+    // Only frames before the clock's starting frame have no keyframe
+    auto keyframe = keyframes_.upper_bound(frame);
+    if (keyframe == keyframes_.begin()) {
+        throw std::runtime_error("no keyframe to seek from");
+    }
+    --keyframe;
+    restore(keyframe->second);
+
+    // Only the staging memory is stepped, the copies of the next frame bring the GPU buffers up to date
+    while (static_cast<uint64_t>(clock_.getCurrentFrame()) < frame) {
+        clock_.step();
+    }
+}
+
+SessionSnapshot SessionTimeline::captureHostState() {
+    SessionSnapshot snapshot;
+    snapshot.frame = clock_.getCurrentFrame();
+    snapshot.staging.resize(stagingSize_);
+    stagingBuffer_.mapAndExecute(0, stagingSize_, [&snapshot](void* mappedData) {
+        memcpy(snapshot.staging.data(), mappedData, snapshot.staging.size());
+    });
+
+    StateWriter writer;
+    clock_.saveState(writer);
+    snapshot.clockState = writer.getData();
+    return snapshot;
+}
+
+void SessionTimeline::finishCapture() {
+    auto readback = [this](BufferIndex index, std::vector<uint8_t>& data) {
+        data.resize(memoryBuffers_[index].size);
+        readbackBuffers_[index]->mapAndExecute(0, data.size(), [&data](void* mappedData) {
+            memcpy(data.data(), mappedData, data.size());
+        });
+    };
+    readback(BufferIndex::PPU, pendingCapture_->ppu);
+    readback(BufferIndex::OAM, pendingCapture_->oam);
+    readback(BufferIndex::CONTROL, pendingCapture_->control);
+
+    uint64_t frame = pendingCapture_->frame;
+    keyframes_.emplace(frame, std::move(*pendingCapture_));
+    pendingCapture_.reset();
+}
+
+void SessionTimeline::restore(const SessionSnapshot& snapshot) {
+    if (snapshot.ppu.size() != memoryBuffers_[BufferIndex::PPU].size
+        || snapshot.oam.size() != memoryBuffers_[BufferIndex::OAM].size
+        || snapshot.control.size() != memoryBuffers_[BufferIndex::CONTROL].size
+        || snapshot.staging.size() != stagingSize_) {
+        throw std::runtime_error("snapshot does not match the session's memory layout");
+    }
+
+    // Throws before any memory is touched if the updators don't match
+    StateReader reader(snapshot.clockState);
+    clock_.loadState(reader);
+
+    // Nothing in flight reads staging or the upload buffers between frames
+    stagingBuffer_.mapAndExecute(0, stagingSize_, [&snapshot](void* mappedData) {
+        memcpy(mappedData, snapshot.staging.data(), snapshot.staging.size());
+    });
+    auto upload = [this](BufferIndex index, const std::vector<uint8_t>& data) {
+        uploadBuffers_[index]->mapAndExecute(0, data.size(), [&data](void* mappedData) {
+            memcpy(mappedData, data.data(), data.size());
+        });
+    };
+    upload(BufferIndex::PPU, snapshot.ppu);
+    upload(BufferIndex::OAM, snapshot.oam);
+    upload(BufferIndex::CONTROL, snapshot.control);
+    restorePending_ = true;
+
+    // A keyframe from before the restore would hold the wrong frame's buffers
+    if (pendingCapture_ && !captureRecorded_) {
+        pendingCapture_.reset();
+    }
+}
+
+void SessionTimeline::recordBeforeUpdates(VkCommandBuffer commandBuffer, uint32_t) {
+    bool capture = pendingCapture_ && !captureRecorded_;
+    if (!restorePending_ && !capture) {
+        return;
+    }
+
+    // After the last frame's reads of the buffers & the copies into them
+    VkMemoryBarrier beforeBarrier{};
+    beforeBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    beforeBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    beforeBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 1, &beforeBarrier, 0, nullptr, 0, nullptr);
+
+    for (size_t i = 0; i < memoryBuffers_.size(); ++i) {
+        VkBufferCopy region{0, 0, memoryBuffers_[i].size};
+        if (restorePending_) {
+            vkCmdCopyBuffer(commandBuffer, uploadBuffers_[i]->getBuffer(), memoryBuffers_[i].buffer, 1, &region);
+        } else {
+            vkCmdCopyBuffer(commandBuffer, memoryBuffers_[i].buffer, readbackBuffers_[i]->getBuffer(), 1, &region);
+        }
+    }
+    if (restorePending_) {
+        restorePending_ = false;
+    } else {
+        captureRecorded_ = true;
+    }
+
+    // Before the frame's updates & dispatches, & the host reading the copies back
+    VkMemoryBarrier afterBarrier{};
+    afterBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    afterBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    afterBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_UNIFORM_READ_BIT
+        | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+                         0, 1, &afterBarrier, 0, nullptr, 0, nullptr);
+}
@@ -0,0 +1,192 @@
+#include "ShaderAutotuner.h"
+#include "PpuBatchRenderer.h"
+#include "UboUtil.h"
+
+#include <VulkanApp.h>
+#include <FileUtil.h>
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace {
+    // Frames rendered by each submission, so the dispatch cost outweighs the submission's
+    const uint BENCHMARK_BATCH = 8;
+}
+
+std::string ShaderVariant::getName() const {
+    std::string name = "nes";
+    for (const auto& feature : features) {
+        name += "_" + feature;
+    }
+    return name;
+}
+
+ShaderAutotuner::ShaderAutotuner(VulkanApp<F>& app, const std::string& cachePath)
+: app_(app), cachePath_(cachePath) {}
+
+const std::vector<ShaderVariant>& ShaderAutotuner::getVariants() {
+    static const std::vector<ShaderVariant> variants = {
+        ShaderVariant{{}, 1, false},
+        ShaderVariant{{"subgroup"}, 1, true},
+        ShaderVariant{{"subgroup", "lines2"}, 2, true},
+        ShaderVariant{{"subgroup", "lines4"}, 4, true},
+        ShaderVariant{{"subgroup", "lines8"}, 8, true},
+    };
+    return variants;
+}
+
+ShaderVariant ShaderAutotuner::select(const NesMemoryState& sample) {
+    std::string deviceKey = getDeviceKey();
+    std::ifstream cache(cachePath_);
+    std::string line;
+    while (std::getline(cache, line)) {
+        if (line.compare(0, deviceKey.size() + 1, deviceKey + " ") != 0) {
+            continue;
+        }
+        std::string name = line.substr(deviceKey.size() + 1);
+        for (const auto& variant : getVariants()) {
+            if (variant.getName() == name) {
+                return variant;
+            }
+        }
+        // Left over from a different set of variants
+        break;
+    }
+
+    auto timings = benchmark(sample);
+    if (timings.empty()) {
+        throw std::runtime_error("no nes.comp variant could be benchmarked");
+    }
+    const VariantTiming* best = &timings.front();
+    for (const auto& timing : timings) {
+        if (timing.matches && timing.score < best->score) {
+            best = &timing;
+        }
+    }
+    persist(best->variant);
+    return best->variant;
+}
+
+std::vector<VariantTiming> ShaderAutotuner::benchmark(const NesMemoryState& sample, uint rounds) {
+    bool subgroupBallot = supportsSubgroupBallot();
+
+    std::vector<const NesMemoryState*> states(BENCHMARK_BATCH, &sample);
+    std::vector<std::vector<uint8_t>> frameData(BENCHMARK_BATCH, std::vector<uint8_t>(PpuBatchRenderer::FRAME_SIZE));
+    std::vector<uint8_t*> frames;
+    for (auto& frame : frameData) {
+        frames.push_back(frame.data());
+    }
+
+    std::vector<VariantTiming> timings;
+    std::vector<uint8_t> reference;
+    for (const auto& variant : getVariants()) {
+        if (variant.needsSubgroupBallot && !subgroupBallot) {
+            continue;
+        }
+
+        std::unique_ptr<PpuBatchRenderer> renderer;
+        try {
+            renderer = std::make_unique<PpuBatchRenderer>(app_,
+                                                          readFile(pathPrefix + "shaders/spirv/" + variant.getName() + ".comp.spirv"),
+                                                          BENCHMARK_BATCH,
+                                                          variant.linesPerGroup);
+        } catch (const std::runtime_error&) {
+            // Missing spirv or a pipeline the driver won't build
+            continue;
+        }
+
+        // The first render warms up the pipeline & is only checked
+        renderer->render(states, frames);
+        if (reference.empty()) {
+            reference = frameData.front();
+        }
+        bool matches = memcmp(reference.data(), frameData.front().data(), reference.size()) == 0;
+
+        VariantTiming timing{variant, {}, 0.0, matches};
+        for (uint scanlineCount : BATCH_SCANLINES) {
+            double best = 0.0;
+            for (uint round = 0; round < rounds; ++round) {
+                auto start = std::chrono::steady_clock::now();
+                renderer->render(states, frames, scanlineCount);
+                double micros = renderer->getLastDispatchMicros();
+                if (micros <= 0.0) {
+                    micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+                }
+                best = round == 0 ? micros : std::min(best, micros);
+            }
+            timing.microsPerBatch.push_back(best / BENCHMARK_BATCH);
+        }
+        timings.push_back(std::move(timing));
+    }
+
+    if (timings.empty()) {
+        throw std::runtime_error("no nes.comp variant could be benchmarked");
+    }
+
+    // Each batch size weighs the same, however long its dispatches take
+    const auto& plain = timings.front().microsPerBatch;
+    for (auto& timing : timings) {
+        for (size_t i = 0; i < BATCH_SCANLINES.size(); ++i) {
+            timing.score += plain[i] > 0.0 ? timing.microsPerBatch[i] / plain[i] : 1.0;
+        }
+        timing.score /= BATCH_SCANLINES.size();
+    }
+    return timings;
+}
+
+void ShaderAutotuner::persist(const ShaderVariant& variant) {
+    std::string deviceKey = getDeviceKey();
+    std::vector<std::string> lines;
+    {
+        std::ifstream cache(cachePath_);
+        std::string line;
+        while (std::getline(cache, line)) {
+            if (!line.empty() && line.compare(0, deviceKey.size() + 1, deviceKey + " ") != 0) {
+                lines.push_back(line);
+            }
+        }
+    }
+    lines.push_back(deviceKey + " " + variant.getName());
+
+    std::ofstream cache(cachePath_, std::ios::trunc);
+    for (const auto& line : lines) {
+        cache << line << "\n";
+    }
+    if (!cache) {
+        throw std::runtime_error("Failed to write autotune cache " + cachePath_);
+    }
+}
+
+bool ShaderAutotuner::supportsSubgroupBallot() const {
+    // vkGetPhysicalDeviceProperties2 is only valid on an instance created for 1.1,
+    // whatever the loader itself supports
+    if (INSTANCE_API_VERSION < VK_API_VERSION_1_1) {
+        return false;
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(app_.getPhysicalDevice(), &properties);
+    if (properties.apiVersion < VK_API_VERSION_1_1) {
+        return false;
+    }
+
+    VkPhysicalDeviceSubgroupProperties subgroupProperties{};
+    subgroupProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties2{};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &subgroupProperties;
+    vkGetPhysicalDeviceProperties2(app_.getPhysicalDevice(), &properties2);
+
+    return (subgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT)
+        && (subgroupProperties.supportedOperations & VK_SUBGROUP_FEATURE_BALLOT_BIT);
+}
+
+std::string ShaderAutotuner::getDeviceKey() const {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(app_.getPhysicalDevice(), &properties);
+    std::ostringstream key;
+    key << std::hex << properties.vendorID << " " << properties.deviceID << " " << properties.driverVersion;
+    return key.str();
+}
@@ -0,0 +1,189 @@
+#include "ShmFeed.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <format>
+#include <new>
+#include <stdexcept>
+
+namespace {
+    size_t slotsOffset() {
+        return (sizeof(ShmFeedHeader) + 63) & ~size_t(63);
+    }
+
+    size_t padTo4(size_t size) {
+        return (size + 3) & ~size_t(3);
+    }
+}
+
+std::unique_ptr<ShmFeedRing> ShmFeedRing::create(const std::string& name, uint32_t slotCount, uint32_t slotSize) {
+    if (slotCount == 0 || slotSize < sizeof(FeedFrameHeader)) {
+        throw std::runtime_error("feed ring needs at least one slot large enough for a frame header");
+    }
+    size_t mappingSize = slotsOffset() + size_t(slotCount) * padTo4(slotSize);
+
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        throw std::runtime_error(std::format("failed to create shared memory {}", name));
+    }
+    if (ftruncate(fd, mappingSize) != 0) {
+        close(fd);
+        shm_unlink(name.c_str());
+        throw std::runtime_error(std::format("failed to size shared memory {}", name));
+    }
+    void* mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        throw std::runtime_error(std::format("failed to map shared memory {}", name));
+    }
+
+    // Indices are constructed before the magic is set, so a consumer never sees a half built header
+    auto* header = new (mapping) ShmFeedHeader{};
+    header->slotCount = slotCount;
+    header->slotSize = padTo4(slotSize);
+    header->version = ShmFeedHeader::VERSION;
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = ShmFeedHeader::MAGIC;
+
+    return std::unique_ptr<ShmFeedRing>(new ShmFeedRing(name, mapping, mappingSize, true));
+}
+
+std::unique_ptr<ShmFeedRing> ShmFeedRing::attach(const std::string& name) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0) {
+        throw std::runtime_error(std::format("no feed at shared memory {}", name));
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < slotsOffset()) {
+        close(fd);
+        throw std::runtime_error(std::format("shared memory {} is too small for a feed", name));
+    }
+    size_t mappingSize = info.st_size;
+    void* mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error(std::format("failed to map shared memory {}", name));
+    }
+
+    auto* header = static_cast<ShmFeedHeader*>(mapping);
+    bool valid = header->magic == ShmFeedHeader::MAGIC
+        && header->version == ShmFeedHeader::VERSION
+        && slotsOffset() + size_t(header->slotCount) * header->slotSize <= mappingSize;
+    if (!valid) {
+        munmap(mapping, mappingSize);
+        throw std::runtime_error(std::format("shared memory {} is not a version {} feed", name, ShmFeedHeader::VERSION));
+    }
+    // The same limits create() enforces, as slot() divides by the count & readers expect a header
+    if (header->slotCount == 0 || header->slotSize < sizeof(FeedFrameHeader)) {
+        munmap(mapping, mappingSize);
+        throw std::runtime_error(std::format("feed {} has no slots large enough for a frame header", name));
+    }
+
+    return std::unique_ptr<ShmFeedRing>(new ShmFeedRing(name, mapping, mappingSize, false));
+}
+
+ShmFeedRing::ShmFeedRing(const std::string& name, void* mapping, size_t mappingSize, bool owner)
+: name_(name),
+  mapping_(mapping),
+  mappingSize_(mappingSize),
+  owner_(owner),
+  header_(static_cast<ShmFeedHeader*>(mapping)),
+  slots_(static_cast<uint8_t*>(mapping) + slotsOffset()) {}
+
+ShmFeedRing::~ShmFeedRing() {
+    munmap(mapping_, mappingSize_);
+    if (owner_) {
+        shm_unlink(name_.c_str());
+    }
+}
+
+uint8_t* ShmFeedRing::slot(uint64_t index) const {
+    return slots_ + (index % header_->slotCount) * header_->slotSize;
+}
+
+uint8_t* ShmFeedRing::beginWrite() {
+    uint64_t writeIndex = header_->writeIndex.load(std::memory_order_relaxed);
+    uint64_t readIndex = header_->readIndex.load(std::memory_order_acquire);
+    if (writeIndex - readIndex >= header_->slotCount) {
+        return nullptr;
+    }
+    return slot(writeIndex);
+}
+
+void ShmFeedRing::endWrite() {
+    header_->writeIndex.fetch_add(1, std::memory_order_release);
+}
+
+const uint8_t* ShmFeedRing::beginRead() {
+    uint64_t readIndex = header_->readIndex.load(std::memory_order_relaxed);
+    uint64_t writeIndex = header_->writeIndex.load(std::memory_order_acquire);
+    if (readIndex == writeIndex) {
+        return nullptr;
+    }
+    return slot(readIndex);
+}
+
+void ShmFeedRing::endRead() {
+    header_->readIndex.fetch_add(1, std::memory_order_release);
+}
+
+FeedFrameWriter::FeedFrameWriter(uint8_t* slot, size_t slotSize, uint64_t frame)
+: header_(reinterpret_cast<FeedFrameHeader*>(slot)),
+  payload_(slot + sizeof(FeedFrameHeader)),
+  capacity_(slotSize - sizeof(FeedFrameHeader)) {
+    header_->frame = frame;
+    header_->recordCount = 0;
+    header_->payloadSize = 0;
+}
+
+bool FeedFrameWriter::addDelta(FeedBuffer buffer, uint32_t offset, const void* data, uint32_t size) {
+    return addRecord(FeedRecord{FEED_DELTA, buffer, 0, offset, size}, data);
+}
+
+bool FeedFrameWriter::addScanlineWrite(uint16_t scanline, uint32_t offset, const void* data, uint32_t size) {
+    return addRecord(FeedRecord{FEED_SCANLINE_WRITE, FEED_CONTROL, scanline, offset, size}, data);
+}
+
+bool FeedFrameWriter::addRecord(const FeedRecord& record, const void* data) {
+    size_t recordSize = sizeof(FeedRecord) + padTo4(record.size);
+    if (header_->payloadSize + recordSize > capacity_) {
+        return false;
+    }
+    uint8_t* destination = payload_ + header_->payloadSize;
+    memcpy(destination, &record, sizeof(FeedRecord));
+    memcpy(destination + sizeof(FeedRecord), data, record.size);
+    header_->payloadSize += recordSize;
+    header_->recordCount += 1;
+    return true;
+}
+
+FeedFrameReader::FeedFrameReader(const uint8_t* slot, size_t slotSize)
+: header_(reinterpret_cast<const FeedFrameHeader*>(slot)),
+  payload_(slot + sizeof(FeedFrameHeader)),
+  payloadSize_(header_->payloadSize) {
+    if (payloadSize_ > slotSize - sizeof(FeedFrameHeader)) {
+        throw std::runtime_error("feed message is larger than its slot");
+    }
+}
+
+bool FeedFrameReader::next(FeedRecord& record, const uint8_t*& data) {
+    if (recordsRead_ == header_->recordCount) {
+        return false;
+    }
+    if (offset_ + sizeof(FeedRecord) > payloadSize_) {
+        throw std::runtime_error("feed message is truncated");
+    }
+    memcpy(&record, payload_ + offset_, sizeof(FeedRecord));
+    if (offset_ + sizeof(FeedRecord) + padTo4(record.size) > payloadSize_) {
+        throw std::runtime_error("feed message is truncated");
+    }
+    data = payload_ + offset_ + sizeof(FeedRecord);
+    offset_ += sizeof(FeedRecord) + padTo4(record.size);
+    recordsRead_ += 1;
+    return true;
+}
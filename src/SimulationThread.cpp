@@ -0,0 +1,85 @@
+#include "SimulationThread.h"
+
+#include <VulkanApp.h>
+
+namespace {
+    const std::chrono::microseconds FRAME_DURATION(16666);
+}
+
+SimulationThread::SimulationThread(VulkanApp<F>& app,
+                                   const std::vector<uint8_t>& initialStaging,
+                                   UpdateList&& updators,
+                                   uint updatorThreads,
+                                   PpuProfiler* profiler)
+: working_(initialStaging.empty() ? std::vector<uint8_t>(1, 0) : initialStaging) {
+    clock_ = std::make_unique<GameClock>(working_.data(), working_.size(), profiler, updatorThreads);
+    for (auto& updator : updators) {
+        clock_->addUpdator(std::move(updator));
+    }
+
+    // Every snapshot starts out as the initial staging memory
+    for (auto& snapshot : snapshots_.getSlots()) {
+        Buffer<uint8_t>::create(snapshot,
+                                working_.size(),
+                                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                app.getDevice(),
+                                app.getPhysicalDevice());
+        snapshot->mapAndExecute(0, working_.size(), [this](void* mappedData) {
+            memcpy(mappedData, working_.data(), working_.size());
+        });
+    }
+
+    thread_ = std::thread([this]() {
+        this->run();
+    });
+}
+
+SimulationThread::~SimulationThread() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    thread_.join();
+}
+
+Buffer<uint8_t>& SimulationThread::acquireLatest() {
+    if (failed_.load(std::memory_order_acquire)) {
+        std::rethrow_exception(error_);
+    }
+    snapshots_.acquire();
+    return *snapshots_.getFront();
+}
+
+void SimulationThread::run() {
+    try {
+        auto nextStep = std::chrono::steady_clock::now() + FRAME_DURATION;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                if (wake_.wait_until(lock, nextStep, [this]() { return stopping_; })) {
+                    return;
+                }
+            }
+
+            clock_->step();
+            auto& back = *snapshots_.getBack();
+            back.mapAndExecute(0, working_.size(), [this](void* mappedData) {
+                memcpy(mappedData, working_.data(), working_.size());
+            });
+            snapshots_.publish();
+            publishedFrame_.store(clock_->getCurrentFrame(), std::memory_order_relaxed);
+
+            // Keep a steady cadence, but don't rush to catch up after a stall
+            nextStep += FRAME_DURATION;
+            auto now = std::chrono::steady_clock::now();
+            if (now > nextStep + FRAME_DURATION) {
+                nextStep = now;
+            }
+        }
+    } catch (...) {
+        error_ = std::current_exception();
+        failed_.store(true, std::memory_order_release);
+    }
+}
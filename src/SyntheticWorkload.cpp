@@ -0,0 +1,185 @@
+#include "SyntheticWorkload.h"
+#include "NesDemo.h"
+
+#include <cstddef>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+
+namespace {
+    const size_t NAMETABLES_OFFSET = offsetof(nes::PPUMemory, nameTables);
+    const size_t NAMETABLES_SIZE = sizeof(nes::PPUMemory::nameTables);
+
+    // Moves every churned sprite one pixel along its own diagonal
+    class SpriteChurner : public GameClock::UpdateFunction {
+    public:
+        SpriteChurner(StagingRegionHandle handle): GameClock::UpdateFunction(handle) {}
+
+        void execute(void* mappedData) override {
+            auto* sprites = static_cast<nes::Sprite*>(mappedData);
+            for (size_t i = 0; i < handle_.size / sizeof(nes::Sprite); ++i) {
+                sprites[i].x += 1 + (i % 3);
+                sprites[i].y = (sprites[i].y + 1 + (i % 2)) % 240;
+            }
+        }
+    protected:
+        uint getFrequency() const override {
+            return 1;
+        }
+    };
+
+    // Rewrites its bytes with the next values of a counter
+    class ByteWriter : public GameClock::UpdateFunction {
+    public:
+        ByteWriter(StagingRegionHandle handle, uint8_t start): GameClock::UpdateFunction(handle), next_(start) {}
+
+        void execute(void* mappedData) override {
+            auto* bytes = static_cast<uint8_t*>(mappedData);
+            for (size_t i = 0; i < handle_.size; ++i) {
+                bytes[i] = next_++;
+            }
+        }
+
+        void saveState(StateWriter& writer) const override {
+            GameClock::UpdateFunction::saveState(writer);
+            writer.write(next_);
+        }
+
+        void loadState(StateReader& reader) override {
+            GameClock::UpdateFunction::loadState(reader);
+            reader.read(next_);
+        }
+    protected:
+        uint getFrequency() const override {
+            return 1;
+        }
+    private:
+        uint8_t next_;
+    };
+
+    // Rotates the animated tiles by one, every 8 frames
+    class TileRotator : public GameClock::UpdateFunction {
+    public:
+        TileRotator(StagingRegionHandle handle): GameClock::UpdateFunction(handle) {}
+
+        void execute(void* mappedData) override {
+            auto* tiles = static_cast<nes::Tile*>(mappedData);
+            size_t tileCount = handle_.size / sizeof(nes::Tile);
+            nes::Tile first = tiles[0];
+            memmove(tiles, tiles + 1, (tileCount - 1) * sizeof(nes::Tile));
+            tiles[tileCount - 1] = first;
+        }
+    protected:
+        uint getFrequency() const override {
+            return 8;
+        }
+    };
+}
+
+SyntheticWorkload::SyntheticWorkload(const SyntheticWorkloadConfig& config)
+: config_(config) {
+    if (config.rasterSplits >= SCANLINES) {
+        throw std::runtime_error("at most one raster split per scanline after the first");
+    }
+    if (config.oamChurn > 64 || config.animatedTiles > 256) {
+        throw std::runtime_error("synthetic workload churns more sprites or tiles than exist");
+    }
+    if (config.updatorBytes == 0 || config.updatorBytes > NAMETABLES_SIZE) {
+        throw std::runtime_error("synthetic updators must write between 1 byte & all four nametables");
+    }
+}
+
+nes::PPUMemory SyntheticWorkload::getPpuMemory(uint session) const {
+    std::mt19937 rng(config_.seed + session);
+    nes::PPUMemory ppu{};
+    auto* bytes = reinterpret_cast<uint8_t*>(&ppu);
+    for (size_t i = 0; i < offsetof(nes::PPUMemory, padding0); ++i) {
+        bytes[i] = static_cast<uint8_t>(rng());
+    }
+    for (auto* palettes : {ppu.backgroundPalettes, ppu.spritePalettes}) {
+        for (uint palette = 0; palette < 4; ++palette) {
+            for (auto& color : palettes[palette].data) {
+                color = rng() % 0x40;
+            }
+        }
+    }
+    return ppu;
+}
+
+nes::OAM SyntheticWorkload::getOam(uint session) const {
+    std::mt19937 rng(config_.seed + session + 0x10000);
+    nes::OAM oam{};
+    for (auto& sprite : oam.sprites) {
+        sprite = nes::Sprite{static_cast<uint8_t>(rng() % 240),
+                             static_cast<uint8_t>(rng()),
+                             static_cast<uint8_t>(rng()),
+                             static_cast<uint8_t>(rng())};
+    }
+    return oam;
+}
+
+nes::Control SyntheticWorkload::getControl() const {
+    return nes::DEMO_CONTROL;
+}
+
+UpdateList SyntheticWorkload::composeUpdates(uint session, MemoryUpdateComposer& composer) const {
+    return composeUpdates(session, composer, getPpuMemory(session), getOam(session));
+}
+
+UpdateList SyntheticWorkload::composeUpdates(uint session,
+                                             MemoryUpdateComposer& composer,
+                                             const nes::PPUMemory& ppu,
+                                             const nes::OAM& oam) const {
+    UpdateList updateList;
+
+    // Splits are spread evenly down the frame, each with its own scroll, &
+    // the frame starts back at no scroll so the last split doesn't carry over
+    if (config_.rasterSplits > 0) {
+        uint16_t xScroll = 0;
+        auto scroll = composer.addStagingField(BufferIndex::CONTROL,
+                                               offsetof(nes::Control, xScroll),
+                                               sizeof(xScroll),
+                                               &xScroll);
+        composer.addUpdate(scroll, 0);
+    }
+    for (uint split = 1; split <= config_.rasterSplits; ++split) {
+        uint16_t xScroll = (split * 37 + session) % 512;
+        auto scroll = composer.addStagingField(BufferIndex::CONTROL,
+                                               offsetof(nes::Control, xScroll),
+                                               sizeof(xScroll),
+                                               &xScroll);
+        composer.addUpdate(scroll, split * SCANLINES / (config_.rasterSplits + 1));
+    }
+
+    if (config_.oamChurn > 0) {
+        auto sprites = composer.addStagingField(BufferIndex::OAM,
+                                                0,
+                                                config_.oamChurn * sizeof(nes::Sprite),
+                                                oam.sprites);
+        composer.addUpdate(sprites, 0);
+        updateList.emplace_back(std::make_unique<SpriteChurner>(sprites));
+    }
+
+    // Updators land at different places in the nametables, wrapping around
+    for (uint i = 0; i < config_.updatorCount; ++i) {
+        size_t offset = (size_t(i) * config_.updatorBytes) % (NAMETABLES_SIZE - config_.updatorBytes + 1);
+        auto bytes = composer.addStagingField(BufferIndex::PPU,
+                                              NAMETABLES_OFFSET + offset,
+                                              config_.updatorBytes);
+        composer.addUpdate(bytes, 0);
+        updateList.emplace_back(std::make_unique<ByteWriter>(bytes, static_cast<uint8_t>(i + session)));
+    }
+
+    if (config_.animatedTiles > 0) {
+        uint firstTile = 256 - config_.animatedTiles;
+        auto tiles = composer.addStagingField(BufferIndex::PPU,
+                                              offsetof(nes::PPUMemory, tileSets)
+                                                + firstTile * sizeof(nes::Tile),
+                                              config_.animatedTiles * sizeof(nes::Tile),
+                                              &ppu.tileSets[0].tiles[firstTile]);
+        composer.addUpdate(tiles, 0);
+        updateList.emplace_back(std::make_unique<TileRotator>(tiles));
+    }
+
+    return updateList;
+}
@@ -0,0 +1,93 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(uint threadCount) {
+    for (uint i = 1; i < threadCount; ++i) {
+        workers_.emplace_back([this]() {
+            workerLoop();
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& task) {
+    if (count == 0) {
+        return;
+    }
+    if (workers_.empty() || count == 1) {
+        for (size_t i = 0; i < count; ++i) {
+            task(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = &task;
+        taskCount_ = count;
+        pendingTasks_ = count;
+        nextTask_ = 0;
+        generation_ += 1;
+    }
+    wake_.notify_all();
+
+    drain(task, count);
+
+    // Workers still inside drain() hold on to task, so wait for them to leave too
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() {
+        return pendingTasks_ == 0 && activeWorkers_ == 0;
+    });
+    task_ = nullptr;
+}
+
+void ThreadPool::workerLoop() {
+    uint64_t seenGeneration = 0;
+    while (true) {
+        const std::function<void(size_t)>* task;
+        size_t count;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this, seenGeneration]() {
+                return stopping_ || (generation_ != seenGeneration && task_ != nullptr);
+            });
+            if (stopping_) {
+                return;
+            }
+            seenGeneration = generation_;
+            task = task_;
+            count = taskCount_;
+            activeWorkers_ += 1;
+        }
+
+        drain(*task, count);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            activeWorkers_ -= 1;
+        }
+        done_.notify_one();
+    }
+}
+
+void ThreadPool::drain(const std::function<void(size_t)>& task, size_t count) {
+    size_t completed = 0;
+    for (size_t i = nextTask_++; i < count; i = nextTask_++) {
+        task(i);
+        completed += 1;
+    }
+    if (completed > 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pendingTasks_ -= completed;
+    }
+    done_.notify_one();
+}
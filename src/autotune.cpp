@@ -0,0 +1,44 @@
+#include "HeadlessApp.h"
+#include "NesDemo.h"
+#include "ShaderAutotuner.h"
+#include "UboUtil.h"
+
+#include <FileUtil.h>
+
+#include <iomanip>
+#include <iostream>
+
+// autotune/ppu <ppu dump> <oam dump>
+// Benchmarks every nes.comp variant against the dumps & persists the fastest for this device
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: autotune/ppu <ppu dump> <oam dump>" << std::endl;
+        return 1;
+    }
+
+    auto app = createHeadlessApp(256);
+
+    NesMemoryState sample{readStructFromFile<nes::PPUMemory>(argv[1]),
+                          readStructFromFile<nes::OAM>(argv[2]),
+                          nes::DEMO_CONTROL};
+
+    ShaderAutotuner autotuner(*app, pathPrefix + "shaders/spirv/autotune.txt");
+    auto timings = autotuner.benchmark(sample);
+
+    const VariantTiming* best = &timings.front();
+    for (const auto& timing : timings) {
+        std::cout << std::setw(24) << std::left << timing.variant.getName() << std::fixed << std::setprecision(2);
+        for (size_t i = 0; i < ShaderAutotuner::BATCH_SCANLINES.size(); ++i) {
+            std::cout << timing.microsPerBatch[i] << "us/" << ShaderAutotuner::BATCH_SCANLINES[i] << " lines  ";
+        }
+        std::cout << "score " << timing.score
+                  << (timing.matches ? "" : "  (output differs, skipped)") << std::endl;
+        if (timing.matches && timing.score < best->score) {
+            best = &timing;
+        }
+    }
+
+    autotuner.persist(best->variant);
+    std::cout << "using " << best->variant.getName() << std::endl;
+    return 0;
+}
@@ -1,38 +1,14 @@
-#include "NesMemory.h"
+#include "NesDemo.h"
 #include "PpuSession.h"
 #include "BufferCycler.h"
+#include "AnimationProgram.h"
 
 #include <format>
 #include <fstream>
 
-static const uint FRAMES = 8;
 static const std::string pathPrefix = "/Users/zyoussef/code/ppu/";
 static const size_t animOffset = offsetof(nes::PPUMemory, tileSets[0]) + offsetof(nes::TileSet, tiles[0xC0]);
 
-class BatmanTilesetAnimator : public GameClock::UpdateFunction {
-public:
-    BatmanTilesetAnimator(StagingRegionHandle handle): GameClock::UpdateFunction(handle) {
-        for (uint i = 0; i < FRAMES; ++i) {
-            std::ifstream dumpFile(std::format("{}/batman/tileframes/{}.bin", pathPrefix, i), 
-                                   std::ios::binary);
-            ppuDumps_[i] = std::vector<uint8_t>(std::istreambuf_iterator<char>(dumpFile), {});
-        }
-    }
-
-    void execute(void* mappedData) override {
-        memcpy(mappedData, ppuDumps_[idx_].data() + animOffset, handle_.size);
-        idx_ = (idx_ + 1) % FRAMES;
-    }
-
-protected:
-    uint getFrequency() const override {
-        return 2;
-    }
-private:
-    std::array<std::vector<uint8_t>, FRAMES> ppuDumps_;
-    uint8_t idx_ = 0;
-};
-
 class NesOamCycler : public GameClock::UpdateFunction {
 public:
     NesOamCycler(StagingRegionHandle handle): GameClock::UpdateFunction(handle) {
@@ -44,6 +20,18 @@ public:
     void execute(void* mappedData) override {
         memcpy(mappedData, bufferCycler.cycleBuffer(sizeof(nes::Sprite)).data(), handle_.size);
     }
+
+    void saveState(StateWriter& writer) const override {
+        GameClock::UpdateFunction::saveState(writer);
+        writer.writeVector(bufferCycler.getBuffer());
+    }
+
+    void loadState(StateReader& reader) override {
+        GameClock::UpdateFunction::loadState(reader);
+        std::vector<uint8_t> buffer;
+        reader.readVector(buffer);
+        bufferCycler.setBuffer(std::move(buffer));
+    }
 protected:
     uint getFrequency() const override {
         return 1;
@@ -54,11 +42,19 @@ private:
 
 int main(int argc, char** argv) {
     PpuSessionConfig nesConfig{256, offsetof(nes::Control, yOffset)};
+    // The tileset & OAM animations write separate staging memory
+    nesConfig.updatorThreads = 2;
+    // Animate at 60Hz regardless of how long presenting takes
+    nesConfig.simulationThread = true;
+    // The animated bank is decoded once per update rather than on every pixel
+    nesConfig.decodedTiles = true;
+    // Presented at 1024x960
+    nesConfig.upscale = UpscaleConfig{4, UPSCALE_SCALENX};
     PpuSession<nes::PPUMemory, nes::OAM, nes::Control> nesSession(nesConfig);
 
     nesSession.init("batman/ppu_dump.bin",
                     "batman/oam_dump.bin",
-                    nes::Control{0, 0, 1, 0, 1, 0, 0, {0,0,0,0,0,0,0}},
+                    nes::DEMO_CONTROL,
                     "shaders/spirv/nes.comp.spirv",
                     [](MemoryUpdateComposer& composer) {
                         auto animTiles = composer.addStagingField(BufferIndex::PPU, 
@@ -71,8 +67,9 @@ int main(int argc, char** argv) {
                                                             sizeof(nes::OAM));
                         composer.addUpdate(oam, 0);
 
-                        UpdateList updateList;
-                        updateList.emplace_back(std::move(std::make_unique<BatmanTilesetAnimator>(animTiles)));
+                        UpdateList updateList = AnimationProgram::load("batman/animations.txt", {
+                            {"animTiles", animTiles},
+                        });
                         updateList.emplace_back(std::move(std::make_unique<NesOamCycler>(oam)));
                         return updateList;
                     });
@@ -0,0 +1,187 @@
+#include "HeadlessApp.h"
+#include "NesFrameTracker.h"
+#include "NesSoftwareRenderer.h"
+#include "PpuSessionHost.h"
+#include "SyntheticWorkload.h"
+#include "UboUtil.h"
+
+#include <FileUtil.h>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    double microsSince(Clock::time_point start) {
+        return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+    }
+
+    // One knob swept away from the baseline, the rest left alone
+    struct Sweep {
+        const char* name;
+        uint SyntheticWorkloadConfig::* knob;
+        std::vector<uint> values;
+    };
+
+    // A session stepped & rendered on the CPU, as the offline exporter does
+    struct CpuSession {
+        std::vector<uint8_t> stagingData;
+        std::unique_ptr<GameClock> clock;
+        std::unique_ptr<NesFrameTracker> frameTracker;
+    };
+
+    struct Measurement {
+        // Mean over the sessions
+        double batches = 0.0;
+        double composeMicros = 0.0;
+        double clockMicros = 0.0;
+        double cpuRenderMicros = 0.0;
+        double gpuTickMicros = -1.0;
+    };
+
+    Measurement measureCpu(const SyntheticWorkload& workload, uint frames) {
+        Measurement measurement;
+        std::vector<CpuSession> sessions(workload.getConfig().sessionCount);
+
+        // Generating the starting memory isn't part of composing
+        std::vector<nes::PPUMemory> ppus;
+        std::vector<nes::OAM> oams;
+        for (uint i = 0; i < sessions.size(); ++i) {
+            ppus.push_back(workload.getPpuMemory(i));
+            oams.push_back(workload.getOam(i));
+        }
+
+        // Composing covers laying out staging, scheduling & expanding the schedule
+        auto start = Clock::now();
+        std::vector<UpdateList> updates;
+        std::vector<UpdateSchedule> schedules;
+        for (uint i = 0; i < sessions.size(); ++i) {
+            MemoryUpdateComposer composer(VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE, offsetof(nes::Control, yOffset));
+            updates.push_back(workload.composeUpdates(i, composer, ppus[i], oams[i]));
+            schedules.push_back(composer.getSchedule());
+            sessions[i].stagingData = composer.getStagingData();
+        }
+        measurement.composeMicros = microsSince(start) / sessions.size();
+        // Every scanline with updates starts a batch, plus one from scanline 0 if it has none
+        for (const auto& schedule : schedules) {
+            measurement.batches += schedule.size() + (schedule.count(0) ? 0 : 1);
+        }
+        measurement.batches /= schedules.size();
+
+        for (uint i = 0; i < sessions.size(); ++i) {
+            auto& session = sessions[i];
+            session.clock = std::make_unique<GameClock>(session.stagingData.data(), session.stagingData.size());
+            for (auto& update : updates[i]) {
+                session.clock->addUpdator(std::move(update));
+            }
+            session.frameTracker = std::make_unique<NesFrameTracker>(ppus[i],
+                                                                     oams[i],
+                                                                     workload.getControl(),
+                                                                     schedules[i]);
+        }
+
+        std::vector<uint8_t> rgba(NesSoftwareRenderer::WIDTH * SCANLINES * NesSoftwareRenderer::BYTES_PER_PIXEL);
+        for (uint frame = 0; frame < frames; ++frame) {
+            start = Clock::now();
+            for (auto& session : sessions) {
+                session.clock->step();
+            }
+            measurement.clockMicros += microsSince(start);
+
+            start = Clock::now();
+            for (auto& session : sessions) {
+                session.frameTracker->beginFrame(session.stagingData.data());
+                NesSoftwareRenderer::renderFrame(*session.frameTracker, rgba.data());
+            }
+            measurement.cpuRenderMicros += microsSince(start);
+        }
+        measurement.clockMicros /= frames;
+        measurement.cpuRenderMicros /= frames;
+        return measurement;
+    }
+
+    double measureGpu(VulkanApp<F>& app,
+                      const std::vector<char>& shaderCode,
+                      const SyntheticWorkload& workload,
+                      uint frames) {
+        uint sessionCount = workload.getConfig().sessionCount;
+        PpuSessionHost host(app, shaderCode, sessionCount);
+        for (uint i = 0; i < sessionCount; ++i) {
+            // Synthetic nametables aren't mirrored
+            host.addSession(workload.getPpuMemory(i), workload.getOam(i), workload.getControl(), nes::FOUR_SCREEN,
+                            [&workload, i](MemoryUpdateComposer& composer) {
+                                return workload.composeUpdates(i, composer);
+                            });
+        }
+
+        // The first tick has nothing in flight to wait on
+        host.tick();
+        auto start = Clock::now();
+        for (uint frame = 0; frame < frames; ++frame) {
+            host.tick();
+        }
+        host.flush();
+        return microsSince(start) / frames;
+    }
+}
+
+// bench/ppu [--gpu] [frames per point]
+// Sweeps each synthetic workload knob on its own & prints the cost per frame as CSV
+int main(int argc, char** argv) {
+    bool gpu = false;
+    uint frames = 120;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--gpu") == 0) {
+            gpu = true;
+        } else {
+            frames = std::max(1ul, std::stoul(argv[i]));
+        }
+    }
+
+    std::unique_ptr<VulkanApp<F>> app;
+    std::vector<char> shaderCode;
+    if (gpu) {
+        app = createHeadlessApp(NesSoftwareRenderer::WIDTH);
+        shaderCode = readFile(pathPrefix + "shaders/spirv/nes.comp.spirv");
+    }
+
+    const std::vector<Sweep> sweeps = {
+        {"raster_splits", &SyntheticWorkloadConfig::rasterSplits, {0, 1, 2, 4, 8, 16, 32, 64, 128}},
+        {"oam_churn", &SyntheticWorkloadConfig::oamChurn, {0, 4, 16, 64}},
+        {"updators", &SyntheticWorkloadConfig::updatorCount, {1, 4, 16, 64, 256}},
+        {"updator_bytes", &SyntheticWorkloadConfig::updatorBytes, {1, 16, 64, 256, 1024}},
+        {"animated_tiles", &SyntheticWorkloadConfig::animatedTiles, {0, 16, 64, 256}},
+        {"sessions", &SyntheticWorkloadConfig::sessionCount, {1, 2, 4, 8, 16, 32}},
+    };
+
+    std::cout << "sweep,value,raster_splits,oam_churn,updators,updator_bytes,animated_tiles,sessions,"
+              << "batches,compose_us,clock_us,cpu_render_us,gpu_tick_us" << std::endl;
+    for (const auto& sweep : sweeps) {
+        for (uint value : sweep.values) {
+            SyntheticWorkloadConfig config;
+            config.*sweep.knob = value;
+            SyntheticWorkload workload(config);
+
+            Measurement measurement = measureCpu(workload, frames);
+            if (app) {
+                measurement.gpuTickMicros = measureGpu(*app, shaderCode, workload, frames);
+            }
+
+            std::cout << sweep.name << "," << value << ","
+                      << config.rasterSplits << "," << config.oamChurn << ","
+                      << config.updatorCount << "," << config.updatorBytes << ","
+                      << config.animatedTiles << "," << config.sessionCount << ","
+                      << measurement.batches << ","
+                      << measurement.composeMicros << "," << measurement.clockMicros << ","
+                      << measurement.cpuRenderMicros << ",";
+            // Left empty when the GPU path wasn't measured
+            if (measurement.gpuTickMicros >= 0.0) {
+                std::cout << measurement.gpuTickMicros;
+            }
+            std::cout << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,37 @@
+#include "NesDemo.h"
+#include "PpuSession.h"
+#include "NesFeedUpdator.h"
+
+#include <iostream>
+
+// Renders frames sent by an emulator over a shared memory feed, see ShmFeed.h
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: feed/ppu <shared memory name>" << std::endl;
+        return 1;
+    }
+    std::string feedName = argv[1];
+
+    // Blank until the emulator sends its first frame
+    static const nes::PPUMemory ppuMemory{};
+    static const nes::OAM oam{};
+    static const nes::Control control = nes::DEMO_CONTROL;
+
+    // Incremental rendering can't see scanline writes, so every scanline is rendered
+    PpuSessionConfig nesConfig{256, offsetof(nes::Control, yOffset)};
+    PpuSession<nes::PPUMemory, nes::OAM, nes::Control> nesSession(nesConfig);
+
+    nesSession.init(ppuMemory,
+                    oam,
+                    control,
+                    "shaders/spirv/nes.comp.spirv",
+                    [&](MemoryUpdateComposer& composer) {
+                        UpdateList updateList;
+                        updateList.emplace_back(NesFeedUpdator::attach(composer, feedName, ppuMemory, oam, control));
+                        return updateList;
+                    });
+
+    nesSession.run();
+
+    return 0;
+}
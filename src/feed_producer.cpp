@@ -0,0 +1,88 @@
+#include "NesDemo.h"
+#include "ShmFeed.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Stand-in for an emulator: sends the smb3 dumps, then animates them the way
+// the smb3 demo does, including a mid-frame nametable switch.
+
+static const std::string pathPrefix = "/Users/zyoussef/code/ppu/";
+
+static volatile std::sig_atomic_t running = 1;
+
+template <typename T>
+static T readDump(const std::string& path) {
+    std::ifstream dumpFile(std::format("{}{}", pathPrefix, path), std::ios::binary);
+    T value{};
+    if (!dumpFile.read(reinterpret_cast<char*>(&value), sizeof(T))) {
+        throw std::runtime_error(std::format("failed to read {}", path));
+    }
+    return value;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: feed/producer <shared memory name>" << std::endl;
+        return 1;
+    }
+    std::signal(SIGINT, [](int) { running = 0; });
+    std::signal(SIGTERM, [](int) { running = 0; });
+
+    auto ppuMemory = readDump<nes::PPUMemory>("smb3/ppu_dump.bin");
+    auto oam = readDump<nes::OAM>("smb3/oam_dump.bin");
+    nes::Control control = nes::DEMO_CONTROL;
+
+    // Room for a full state message plus a few writes
+    auto ring = ShmFeedRing::create(argv[1], 4, 20 * 1024);
+    std::cout << std::format("feeding {}, start feed/ppu {} to watch", argv[1], argv[1]) << std::endl;
+
+    const uint8_t statusBarNametable = 2;
+
+    bool sentFullState = false;
+    uint64_t frame = 0;
+    auto nextFrame = std::chrono::steady_clock::now();
+    while (running) {
+        nextFrame += std::chrono::microseconds(16666);
+        std::this_thread::sleep_until(nextFrame);
+        ++frame;
+
+        uint8_t color = nes::demoPaletteColor(frame / 4);
+        ppuMemory.backgroundPalettes[3].data[2] = color;
+        for (size_t i = 0; i < 6; ++i) {
+            oam.sprites[i].x += 1;
+        }
+        control.xScroll = (frame / 2) % 512;
+
+        // The consumer is behind, so drop this frame rather than block
+        uint8_t* slot = ring->beginWrite();
+        if (slot == nullptr) {
+            continue;
+        }
+
+        FeedFrameWriter writer(slot, ring->getSlotSize(), frame);
+        if (!sentFullState) {
+            writer.addDelta(FEED_PPU, 0, &ppuMemory, sizeof(ppuMemory));
+            writer.addDelta(FEED_OAM, 0, &oam, sizeof(oam));
+            writer.addDelta(FEED_CONTROL, 0, &control, sizeof(control));
+            sentFullState = true;
+        }
+        writer.addDelta(FEED_PPU, nes::DEMO_PALETTE_ENTRY, &color, sizeof(color));
+        writer.addDelta(FEED_OAM, 0, &oam.sprites[0], 6 * sizeof(nes::Sprite));
+        // The playfield scrolls while the status bar below it stays put
+        writer.addScanlineWrite(0, offsetof(nes::Control, xScroll), &control.xScroll, sizeof(control.xScroll));
+        writer.addScanlineWrite(192, offsetof(nes::Control, nametableStart), &statusBarNametable, sizeof(statusBarNametable));
+        uint16_t noScroll = 0;
+        writer.addScanlineWrite(192, offsetof(nes::Control, xScroll), &noScroll, sizeof(noScroll));
+        ring->endWrite();
+    }
+
+    return 0;
+}
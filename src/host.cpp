@@ -0,0 +1,82 @@
+#include "HeadlessApp.h"
+#include "NesDemo.h"
+#include "PpuSessionHost.h"
+#include "ScriptScheduler.h"
+#include "UboUtil.h"
+
+#include <FileUtil.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+// Cycles the demo palette entry every 4 frames, starting at a different point for each session
+static UpdateScript cyclePalette(ScriptScheduler& scripts, uint phase) {
+    for (uint step = phase; ; ++step) {
+        co_await scripts.frames(4);
+        scripts.write(BufferIndex::PPU, nes::DEMO_PALETTE_ENTRY, nes::demoPaletteColor(step));
+    }
+}
+
+// host/ppu <session count> <frame count> [session 0 output.rgba|output.ncap]
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: host/ppu <session count> <frame count> [output.rgba|output.ncap]" << std::endl;
+        return 1;
+    }
+    uint sessionCount = std::stoul(argv[1]);
+    uint64_t frameCount = std::stoull(argv[2]);
+
+    auto app = createHeadlessApp(NesSoftwareRenderer::WIDTH);
+
+    auto ppu = readStructFromFile<nes::PPUMemory>("smb3/ppu_dump.bin");
+    auto oam = readStructFromFile<nes::OAM>("smb3/oam_dump.bin");
+    nes::Control control = nes::DEMO_CONTROL;
+
+    // Every session starts from the same dump, & SMB3's cartridge mirrors horizontally
+    const nes::Mirroring mirroring = nes::HORIZONTAL_MIRRORING;
+    PpuSessionHost host(*app,
+                        readFile(pathPrefix + "shaders/spirv/nes_compact.comp.spirv"),
+                        sessionCount,
+                        4,
+                        true);
+
+    std::ofstream output;
+    std::unique_ptr<ScanlineCaptureWriter> capture;
+    if (argc >= 4) {
+        output.open(argv[3], std::ios::binary);
+        if (isScanlineCapturePath(argv[3])) {
+            capture = std::make_unique<ScanlineCaptureWriter>(output, NesSoftwareRenderer::WIDTH, SCANLINES);
+        }
+    }
+    for (uint i = 0; i < sessionCount; ++i) {
+        FrameSink sink = nullptr;
+        if (i == 0 && output.is_open()) {
+            sink = capture ? OfflineExporter::scanlineCaptureSink(*capture) : OfflineExporter::rawVideoSink(output);
+        }
+        host.addSession(ppu, oam, control, mirroring, [i](MemoryUpdateComposer& composer) {
+            uint8_t initialColor = 0x17;
+            auto scripts = std::make_unique<ScriptScheduler>();
+            scripts->addTarget(composer, BufferIndex::PPU, nes::DEMO_PALETTE_ENTRY, sizeof(uint8_t), 0, &initialColor);
+            scripts->start([i](ScriptScheduler& scheduler) {
+                return cyclePalette(scheduler, i);
+            });
+            UpdateList updateList;
+            updateList.emplace_back(std::move(scripts));
+            return updateList;
+        }, sink);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t frame = 0; frame < frameCount; ++frame) {
+        host.tick();
+    }
+    host.flush();
+    if (capture) {
+        capture->finish();
+    }
+    auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start);
+
+    std::cout << sessionCount << " sessions, " << elapsed.count() / std::max<uint64_t>(frameCount, 1) << "us per tick" << std::endl;
+    return 0;
+}
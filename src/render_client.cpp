@@ -0,0 +1,37 @@
+#include "NesDemo.h"
+#include "PpuBatchRenderer.h"
+#include "RenderClient.h"
+#include "UboUtil.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+// Renders smb3 frames through a running service/ppu, cycling a palette entry
+// so that every request after the first is a small delta
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        std::cerr << "usage: service/client <socket path> <frame count> <output.rgba>" << std::endl;
+        return 1;
+    }
+    uint64_t frameCount = std::stoull(argv[2]);
+
+    auto state = std::make_unique<NesMemoryState>();
+    state->ppu = readStructFromFile<nes::PPUMemory>("smb3/ppu_dump.bin");
+    state->oam = readStructFromFile<nes::OAM>("smb3/oam_dump.bin");
+    state->control = nes::DEMO_CONTROL;
+
+    RenderClient client(argv[1]);
+    std::ofstream output(argv[3], std::ios::binary);
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t frame = 0; frame < frameCount; ++frame) {
+        state->ppu.backgroundPalettes[3].data[2] = nes::demoPaletteColor(frame / 4);
+        const uint8_t* rgba = client.render(*state);
+        output.write(reinterpret_cast<const char*>(rgba), PpuBatchRenderer::FRAME_SIZE);
+    }
+    auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start);
+
+    std::cout << frameCount << " frames, " << elapsed.count() / std::max<uint64_t>(frameCount, 1) << "us per frame" << std::endl;
+    return 0;
+}
@@ -0,0 +1,34 @@
+#include "HeadlessApp.h"
+#include "RenderService.h"
+#include "UboUtil.h"
+
+#include <FileUtil.h>
+
+#include <csignal>
+#include <iostream>
+
+static RenderService* service = nullptr;
+
+// Serves render requests until interrupted, see RenderService.h for the protocol
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: service/ppu <socket path>" << std::endl;
+        return 1;
+    }
+
+    auto app = createHeadlessApp(PpuBatchRenderer::WIDTH);
+
+    RenderServiceConfig config;
+    config.socketPath = argv[1];
+    RenderService renderService(*app, readFile(pathPrefix + "shaders/spirv/nes.comp.spirv"), config);
+
+    service = &renderService;
+    std::signal(SIGINT, [](int) { service->stop(); });
+    std::signal(SIGTERM, [](int) { service->stop(); });
+    std::signal(SIGPIPE, SIG_IGN);
+
+    std::cout << "serving on " << config.socketPath << std::endl;
+    renderService.run();
+
+    return 0;
+}